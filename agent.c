@@ -22,21 +22,41 @@ IF ISLAND FOUND
 This order was chosen heuristically in part but largely because it guarantees we gather as much information as possible before doing anything risky, and then taking the action which has the least risk at any given time but still makes progress.
 
 Algorithms:
-A* Search - Used to search for a path whenever we know the specific space we are searching for e.g. collecting the gold when we have seen it, finding the path from one point to another.
-The heuristic used is an adjusted version of the manhattan distance heuristic to adjust for the fact that turning 90 degrees takes up an action.
-BFS - When we are searching for the path from one point to a specific island. We do not know which port on the specific island will be found first so we cannot use the manhattan distance heuristic but an optimal path is still vital for using stones for water traversal. For ths reasons BFS was selected.
-Floodfill - floodfill is used a lot to determine the closest space of a specific type to the agent. Floodfilling radially outwards from the agent ensures the first one found will be the closest to the agent and if we only continue the search from seen passable spaces we re guaranteed a viable path.
-Floodfill is also used to create an island map as all passable spaces adjacent to one another can be thought of as one island.
+All searches run iteratively over a lattice of (x, y, direction) states with a closed set, so turning costs are
+exact and every state is expanded at most once.
+D* Lite - search_setup() uses an incremental planner which searches backwards from the goal and
+keeps its costs between turns. When update_Wmap() (or a new tool) changes a space only the affected states are repaired.
+Pareto search - the route across the water is picked from every crossing that isn't beaten on both stones used and actions taken,
+found by crossing_front() in one search, so a crossing by stones uses as few as it can and one by raft is as short as it can be.
+plan_crossings() runs one BFS over the water seeded with every port on the agent's island, so the shortest crossing to every
+other island comes out of a single search.
+Exploring picks where to stand by how much unseen space the view would show from there for the actions it costs (best_view()).
+Survey - the closest space of each kind the decision cascade asks for from the agent (unseen space, perimeter, items, blocking trees,
+stones and water) comes from one turn aware Dijkstra search per turn that only runs as far as the questions asked so far need.
+Floodfill - floodfill is used a lot to determine the closest space of a specific type to a space. Floodfilling radially outwards from the agent ensures the first one found will be the closest to the agent and if we only continue the search from seen passable spaces we re guaranteed a viable path.
+Every flood fill borrows a preallocated Workspace (queue of spaces + visited map) instead of putting ~300KB on the stack.
+Visited maps are epoch stamped so clearing one is a single increment.
+Island mapping scans outwards from the agent bitwise instead: each tile mirrors its symbols as bitplanes
+(open land, water, unseen, trees, stones, doors) and the scan steps a whole tile row per operation.
 
 Structures used:
-Stack: priority stack used for both A* and BFS.
-For A* the stack is prioritised by distance from the start + adjusted manhattan distance.
-For BFS the stack is only prioritised by distance from start.
+AgentContext: everything below belongs to one agent context (ctx, handed to every function), so a process can play many games
+(see agent_new()).
+Queue: bucket priority queue used by the Pareto crossing search and the hop planner. All costs are small integers so each
+priority has its own bucket and push/pop are O(1) (plus a scan over empty buckets), with nodes taken from a reusable pool.
 agent: a struct containing information about the agent in its current state e.g. if it is holding a raft, if it has a key, if it has seen gold etc.
-Wmap: used as the agent's general map of the world it has seen so far.
-placesBeen: stores every space the agent has occupied
-islandMap: a floodfill map of all islands the agent can see (areas of passable space separated by unknown space or water)
-islandsInfo: a list of profiles (struct Island) for all the islands we have found, storing useful spaces found on the island (gold, tools, etc.)
+world: a sparse map store of 32x32 tiles allocated as the agent sees them, so there is no limit on the world size.
+It holds the agent's general map of the world seen so far (wmap_at()), every space the agent has occupied (been_at())
+and a map of all islands the agent can see (island_at(), areas of passable space separated by unknown space or water).
+islandSets: a union-find over every space passable at island time, updated as spaces are seen, along with what is on each island.
+crossings: the shortest water crossing from each island to every other, built per island and kept until the island map changes.
+When the hop planner needs many rows at once they are built in parallel by a small thread pool (pool).
+create_islandMap() numbers and labels its islands without flood filling them, and on_same_island() asks it directly.
+All searches index their scratch arrays by the store's cell numbers and they grow with it.
+speculation: the next turn's action, planned on a second thread while the engine works out the last one
+routePlanner: an incremental D* Lite planner that keeps its search between turns and only repairs what changed
+plan: the whole action sequence of the last search, replayed on later turns while it is still valid
+islandsInfo: a growable list of profiles (struct Island) for all the islands we have found, storing useful spaces found on the island (gold, tools, etc.)
 IslandCrossing ic: a struct containing the information for the current planned hop from the current island to a new island.
 */
 #include <stdio.h>
@@ -44,30 +64,168 @@ IslandCrossing ic: a struct containing the information for the current planned h
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h> 
+#include <pthread.h>
+#include <time.h>
+#ifndef AGENT_NO_MAIN
 #include "pipe.h"
+#endif
 #include "agent.h"
 
-char view[5][5];
-char Wmap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-Agent agent = {{AGENT_START, AGENT_START}, UP, 0, false, false,
-  false, false, false, {-1, -1}, {-1, -1}, {-1, -1}};
-IslandCrossing ic = {-1, -1, {-1,-1}, {-1,-1}, -1, false};
-Island islandsInfo[40] = {0};
-int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {0};
-int placesBeen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {0};
+//helpers only used in this file
+static int newNode(Queue q, int xPos, int yPos, int dir,
+  int distFromStart, int heuristicCost);
+static void disposeNode(Queue q, int node);
+static int find_tile(AgentContext *ctx, int tileX, int tileY);
+static void directory_insert(AgentContext *ctx, int slot);
+static int new_tile(AgentContext *ctx, int tileX, int tileY);
+
+int   pipe_fd;
+FILE* in_stream;
+FILE* out_stream;
+
+__thread TileCache tileCache = {0, 0, 0, NO_TILE};
+static unsigned long storesMade = 0;
 
 //main style function uses the data collected on the world thus far
 //and the position of the bot currently to decide which action to take next.
-char get_action(char view[5][5]) {
-  update_Wmap(view);
+//The view can come from anywhere (see sim.c), so it is copied to where the rest of the agent reads it
+char get_action(AgentContext *ctx, char newView[5][5]) {
+  if(newView != ctx->view) memcpy(ctx->view, newView, sizeof(ctx->view));
+  workspace_tick(ctx);
+  deadline_start(ctx);
+  update_Wmap(ctx, ctx->view);
   char action = 0;
+  //if nothing new came into view the plan made while waiting for it still stands
+  if(speculation_accepted(ctx)) action = ctx->speculation.action;
+  else action = plan_action(ctx);
+  //nothing planned in time (or a plan we can't trust): do something that can't kill us
+  if(action == 0 || !action_is_safe(ctx, action)) {
+    if(action != 0) ctx->deadline.vetoed++;
+    action = safe_action(ctx);
+  }
+  deadline_end(ctx);
+  update_agent(ctx, action);
+  return action;
+}
 
-  //handles trees and doors
-  action = cut_or_unlock();
-  if(action > 0) {
-    update_agent(action);
-    return action;
+//The agent context. Everything the agent knows and plans with lives in an AgentContext rather than in globals,
+//so one process can play any number of games, one after the other or side by side on different threads.
+//Every function that reads or changes what the agent knows takes the context as ctx, its first argument, and the
+//thread pool's workers and the speculative planner are handed the context they belong to when they start.
+//The only state kept outside a context is each thread's tileCache, which is tagged with the map store it was
+//filled from. A context must only be stepped by one thread at a time.
+
+//a new agent, at its start facing up with nothing seen and nothing in hand
+AgentContext *agent_new(void) {
+  AgentContext *context = calloc(1, sizeof(AgentContext));
+  if(context == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  context->agent.location.x = AGENT_START;
+  context->agent.location.y = AGENT_START;
+  context->agent.direction = UP;
+  context->agent.seenGold = (Coords){-1, -1};
+  context->agent.seenAxe = (Coords){-1, -1};
+  context->agent.seenKey = (Coords){-1, -1};
+  context->ic = (IslandCrossing){-1, -1, {-1, -1}, {-1, -1}, -1, false};
+  context->islandSets.freeSets = NO_SET;
+  context->deadline.budgetMs = TICK_BUDGET_MS;
+  context->world.id = __sync_add_and_fetch(&storesMade, 1);
+  return context;
+}
+
+//the action a context's agent takes on seeing view
+char agent_step(AgentContext *ctx, char view[5][5]) {
+  return get_action(ctx, view);
+}
+
+//plan a context's turns on the calling thread only, for callers that already keep every core busy with
+//games of their own. Must be called before the context's first step
+void agent_serial(AgentContext *ctx) {
+  assert(!ctx->pool.started);
+  ctx->pool.serial = true;
+}
+
+//end a context's threads and free everything it allocated
+void agent_free(AgentContext *ctx) {
+  int i, j;
+  if(ctx == NULL) return;
+  speculation_stop(ctx);
+  pool_stop(ctx);
+  MapStore *w = &ctx->world;
+  free(w->tileOrigin);
+  free(w->directory);
+  free(w->symbols);
+  free(w->islands);
+  free(w->been);
+  free(w->islandParent);
+  free(w->islandSet);
+  free(w->planes);
+  free(ctx->islandsInfo);
+  free(ctx->islandSets.sets);
+  for(i = 0; i < ctx->crossings.numRows; i++) free(ctx->crossings.rows[i].edges);
+  free(ctx->crossings.rows);
+  free(ctx->crossings.scratch.edges);
+  PlanCache *p = &ctx->plan;
+  free(p->actions);
+  free(p->states);
+  free(p->path);
+  free(p->pathId);
+  free(p->pathIndex);
+  free(ctx->speculation.path);
+  DStar *d = &ctx->routePlanner;
+  free(d->stamp);
+  free(d->g);
+  free(d->rhs);
+  free(d->key1);
+  free(d->key2);
+  free(d->heapPos);
+  free(d->heap);
+  for(i = 0; i < NUM_WORKSPACES + NUM_WORKERS; i++) {
+    Workspace *ws = &ctx->workspaces[i];
+    free(ws->stamp);
+    free(ws->spaces);
+    free(ws->from);
+    free(ws->ports);
+    for(j = 0; j < NUM_REGIONS; j++) {
+      free(ws->regions[j].stamp);
+      free(ws->regions[j].rows);
+      free(ws->regions[j].tiles);
+    }
+  }
+  Survey *s = &ctx->survey;
+  free(s->stamp);
+  free(s->cost);
+  free(s->move);
+  free(s->enterStamp);
+  free(s->enterCost);
+  free(s->enterFrom);
+  free(s->entered);
+  free(s->queue.pool);
+  free(ctx->pareto.stamp);
+  free(ctx->pareto.head);
+  free(ctx->pareto.pool);
+  free(ctx->pareto.front);
+  free(ctx->hops.labels);
+  free(ctx->hops.sets);
+  free(ctx->hops.head);
+  free(ctx->hops.jobs);
+  for(i = 0; i < NUM_FRONTIERS; i++) {
+    free(ctx->frontiers.sets[i].members);
+    free(ctx->frontiers.sets[i].slot);
   }
+  free(ctx->searchQueue.pool);
+  free(ctx);
+}
+
+//the decision cascade. Returns 0 if it found nothing to do before the deadline
+char plan_action(AgentContext *ctx) {
+  char action = 0;
+
+  //handles trees and doors
+  action = cut_or_unlock(ctx);
+  if(action > 0) return action;
 
   int targetX = -1;
   int targetY = -1;
@@ -75,100 +233,93 @@ char get_action(char view[5][5]) {
 
   //if we are on a raft, explore all water tiles
   //which may have information on adjacent islands
-  if(agent.currentlyRafting && closest_reachable(agent.location,
+  if(ctx->agent.currentlyRafting && closest_reachable(ctx, ctx->agent.location,
     &targetX, &targetY, UNSEEN_WATER)) {
 
-    action = search_setup(targetX, targetY, WATER);
-    ic.islandNum = -1;
-    update_agent(action);
+    ctx->goalTier = TIER_WATER_EXPLORE;
+    action = search_setup(ctx, targetX, targetY, WATER);
+    ctx->ic.islandNum = -1;
     return action;
   }
-  while(action == 0) {
-    if(Wmap[agent.location.y][agent.location.x] != '~') {
+  //each pass either returns an action or changes the planned island hop, so a few passes are enough
+  int pass;
+  for(pass = 0; pass < MAX_PLANNING_PASSES && !deadline_passed(ctx); pass++) {
+    if(wmap_at(ctx, ctx->agent.location.x, ctx->agent.location.y) != '~') {
       //if we have seen a useful item which can be pathed to by land, do so
-      action = collect_seen_items();
+      ctx->goalTier = TIER_COLLECT_ITEMS;
+      action = collect_seen_items(ctx);
       if(action > 0) {
-        update_agent(action);
-        ic.islandNum = -1;
+        ctx->ic.islandNum = -1;
         return action; 
       }
-      //if there is unseen space adjacent to a passable space, path there 
-      //to explore the interior of the current island
-      if(closest_reachable(agent.location, &targetX,
-        &targetY, UNSEEN)) {
-        action = search_setup(targetX, targetY, LAND); 
-        update_agent(action);
-        ic.islandNum = -1;
+      //if there is unseen space adjacent to a passable space, path to where
+      //the view will show the most of it to explore the interior of the current island
+      if(best_view(ctx, &targetX, &targetY)) {
+        ctx->goalTier = TIER_EXPLORE;
+        action = search_setup(ctx, targetX, targetY, LAND); 
+        ctx->ic.islandNum = -1;
         return action;
       } 
       //explores the perimeter of the current island to
       //ensure we have full information for island hopping
-      if(closest_reachable(agent.location, &targetX,
+      if(closest_reachable(ctx, ctx->agent.location, &targetX,
         &targetY, PERIMETER)) {
-          action = search_setup(targetX, targetY, LAND);
-          update_agent(action);
-          ic.islandNum = -1;
+          ctx->goalTier = TIER_PERIMETER;
+          action = search_setup(ctx, targetX, targetY, LAND);
+          ctx->ic.islandNum = -1;
           return action;
       }
     }
     //if we are not currently performing a planned island hop, map all seen islands
     int numIslands;
-    if(ic.islandNum == -1) {
-      numIslands = create_islandMap(agent.location,
-        islandMap, islandsInfo);
+    if(ctx->ic.islandNum == -1) {
+      numIslands = create_islandMap(ctx, ctx->agent.location);
       //if there are other islands to explore, chose the best one.
       //procedure explained in choose_island
       if(numIslands > 1) {
-        choose_island(numIslands, islandsInfo, &ic, islandMap);
-        if(ic.islandNum == -1) ic.stage = -1;
+        choose_island(ctx, numIslands, ctx->islandsInfo, &ctx->ic);
+        if(ctx->ic.islandNum == -1) ctx->ic.stage = -1;
       } else {
         //if there are no other islands, then the agent must either need to return the gold
         //or there is an object blocking our path that we must collect to progress
         //(trees and rocks purposefully not collected until specifically mapped to to avoid
-        //inefficient use in island hopping)
-        if(agent.gold) continue;
-        else {
-          action = clear_path();
-          if(action > 0) {
-            update_agent(action);
-            return action;
-          }
-        }
+        //inefficient use in island hopping). With the gold that is all that can be keeping us from home
+        ctx->goalTier = TIER_CLEAR_PATH;
+        action = clear_path(ctx);
+        if(action > 0) return action;
       }
     }
     //if on a raft we do not need to care about resources, just map to the chosen island
-    if(agent.currentlyRafting) {
-      action = water_crossing();
-      update_agent(action);
+    if(ctx->agent.currentlyRafting) {
+      ctx->goalTier = TIER_WATER_CROSSING;
+      action = water_crossing(ctx);
       return action;
     //before the agent can complete an island hop it must appropriate collect resources
     //and move to the chosen port
     //(port meaning a passable space adjacent to water)
-    } else if(ic.stage == TO_HOME_PORT) {
-      action = prepare_for_island_hop();
+    } else if(ctx->ic.stage == TO_HOME_PORT) {
+      ctx->goalTier = TIER_ISLAND_HOP;
+      action = prepare_for_island_hop(ctx);
       if(action > 0) {
-        update_agent(action);
         return action;
       }
     //once at port, map a path through the water to the chosen port on the chosen island
-    } else if(ic.stage == WATER_CROSSING_TO_ISLAND) {
-      action = water_crossing();
+    } else if(ctx->ic.stage == WATER_CROSSING_TO_ISLAND) {
+      ctx->goalTier = TIER_WATER_CROSSING;
+      action = water_crossing(ctx);
       if(action > 0) {
-        update_agent(action);
         return action;
       }
     //if there are other islands but we cannot reach them there must be an object blocking our path
     //so we must collect it to progress.
     } else {
-      int maxCost = find_blocking(agent.location,
-        &targetX, &targetY, 'o');
-      if(maxCost <= 0 && agent.axe) {
-        maxCost = find_blocking(agent.location,
-          &targetX, &targetY, 'T');
+      ctx->goalTier = TIER_BLOCKING;
+      int maxCost = find_blocking(ctx, &targetX, &targetY, 'o');
+      if(maxCost <= 0 && ctx->agent.axe) {
+        maxCost = find_blocking(ctx, &targetX, &targetY, 'T');
       }
       if(maxCost > 0) {
-        action = search_setup(targetX, targetY, LAND);
-        update_agent(action);
+        action = search_setup(ctx, targetX, targetY, LAND);
         return action;
       }
     }
@@ -178,17 +329,18 @@ char get_action(char view[5][5]) {
 
 //if we have mapped to a tree or door and have the appropriate tool,
 //perform the appropriate action
-char cut_or_unlock(void) {
+char cut_or_unlock(AgentContext *ctx) {
   int forwardX, forwardY;
   char action = 0;
-  result_of_move(agent.location.x, agent.location.y,
-    agent.direction, &forwardX, &forwardY);
-  switch (Wmap[forwardY][forwardX]){
+  result_of_move(ctx->agent.location.x, ctx->agent.location.y,
+    ctx->agent.direction, &forwardX, &forwardY);
+  switch (wmap_at(ctx, forwardX, forwardY)){
     case '-':
-      if(agent.key) action = 'u';
+      if(ctx->agent.key) action = 'u';
       break;
     case 'T':
-      if(agent.axe) action = 'c';
+      //a raft chopped while rafting sinks as soon as we land, so only chop from land
+      if(ctx->agent.axe && !ctx->agent.currentlyRafting) action = 'c';
   }
   return action;
 }
@@ -197,39 +349,40 @@ char cut_or_unlock(void) {
 //on the same island as the agent, attempt to map to it (as we
 //will have saved the item's coordinates in update_agent() when we saw it)
 //Item priority order: gold, key, axe
-char collect_seen_items(void) {
+char collect_seen_items(AgentContext *ctx) {
   char action = 0;
-  if(agent.gold == true && 
-    on_same_island(agent.location.x, agent.location.y,
+  if(ctx->agent.gold == true && 
+    on_same_island(ctx, ctx->agent.location.x, ctx->agent.location.y,
       AGENT_START, AGENT_START)) {
 
-    action = target_item(AGENT_START, AGENT_START);
+    action = target_item(ctx, GOAL_HOME);
   } 
-  if(action == 0 && agent.seenGold.x != -1 && agent.gold == false && 
-    on_same_island(agent.location.x, agent.location.y,
-    agent.seenGold.x, agent.seenGold.y)) {
+  if(action == 0 && ctx->agent.seenGold.x != -1 && ctx->agent.gold == false && 
+    on_same_island(ctx, ctx->agent.location.x, ctx->agent.location.y,
+    ctx->agent.seenGold.x, ctx->agent.seenGold.y)) {
 
-    action = target_item(agent.seenGold.x, agent.seenGold.y);
+    action = target_item(ctx, GOAL_GOLD);
   }
-  if(action == 0 && agent.seenKey.x != -1 && agent.key == false && 
-    on_same_island(agent.location.x, agent.location.y,
-      agent.seenKey.x, agent.seenKey.y)) {
+  if(action == 0 && ctx->agent.seenKey.x != -1 && ctx->agent.key == false && 
+    on_same_island(ctx, ctx->agent.location.x, ctx->agent.location.y,
+      ctx->agent.seenKey.x, ctx->agent.seenKey.y)) {
 
-    action = target_item(agent.seenKey.x, agent.seenKey.y);
+    action = target_item(ctx, GOAL_KEY);
   }
-  if(action == 0 && agent.seenAxe.x != -1 && agent.axe == false && 
-    on_same_island(agent.location.x, agent.location.y,
-      agent.seenAxe.x, agent.seenAxe.y)) {
+  if(action == 0 && ctx->agent.seenAxe.x != -1 && ctx->agent.axe == false && 
+    on_same_island(ctx, ctx->agent.location.x, ctx->agent.location.y,
+      ctx->agent.seenAxe.x, ctx->agent.seenAxe.y)) {
 
-    action = target_item(agent.seenAxe.x, agent.seenAxe.y);
+    action = target_item(ctx, GOAL_AXE);
   }
   return action; 
 }
 
-//if the target  coords a reachable from the agent's current position, map to it.
-char target_item(int targetX, int targetY) {
-  if(is_reachable(agent.location, targetX, targetY)) {
-      int action = search_setup(targetX, targetY, LAND);
+//if the item is reachable from the agent's current position, map to it.
+char target_item(AgentContext *ctx, int goal) {
+  int targetX, targetY;
+  if(survey_nearest(ctx, goal, &targetX, &targetY) >= 0) {
+      int action = search_setup(ctx, targetX, targetY, LAND);
     return action;
   } else return 0;   
 }
@@ -239,54 +392,50 @@ char target_item(int targetX, int targetY) {
 //do not treat it as such during normal exploration (trees, stones, water).
 //For each blocking space type we attempt to find provable blocking space, and then failing
 //that just any instance of that item as a precaution.
-char clear_path(void) {
+char clear_path(AgentContext *ctx) {
   int targetX, targetY;
   int result;
   char action = 0;
   //explore blocking water with a raft
-  if(agent.raft) {
-    result = find_blocking(agent.location,
-      &targetX, &targetY, '~');
+  if(ctx->agent.raft) {
+    result = find_blocking(ctx, &targetX, &targetY, '~');
     if(result == 0) action = 'f';
     else if(result > 0) {
-      action = search_setup(targetX, targetY, LAND);
+      action = search_setup(ctx, targetX, targetY, LAND);
     }
   }
   //cut down a blocking tree
-  if(action == 0 && islandsInfo[0].tree == true && agent.axe) {
-    result = find_blocking(agent.location,
-      &targetX, &targetY, 'T');
+  if(action == 0 && ctx->islandsInfo[0].tree == true && ctx->agent.axe) {
+    result = find_blocking(ctx, &targetX, &targetY, 'T');
     if(result <= 0) {
-      result = closest_reachable(agent.location,
+      result = closest_reachable(ctx, ctx->agent.location,
         &targetX, &targetY, 'T');
     }
     if(result > 0) {
-      action = search_setup(targetX, targetY, LAND);
+      action = search_setup(ctx, targetX, targetY, LAND);
     }
   }
   //attempt to traverse blocking water with stones 
-  if(action == 0 && agent.stones > 0) {
-    result = find_blocking(agent.location,
-      &targetX, &targetY, '~');
+  if(action == 0 && ctx->agent.stones > 0) {
+    result = find_blocking(ctx, &targetX, &targetY, '~');
     if(result <= 0) {
-      result = closest_reachable(agent.location,
+      result = closest_reachable(ctx, ctx->agent.location,
         &targetX, &targetY, '~');
     }
     if(result < 0) {
-      action = search_setup(targetX, targetY, LAND);
+      action = search_setup(ctx, targetX, targetY, LAND);
     }
   }
   //pick up a blocking stone
-  if(action == 0 && islandsInfo[0].stones > 0) {
-    result = find_blocking(agent.location,
-      &targetX, &targetY, 'o');
+  if(action == 0 && ctx->islandsInfo[0].stones > 0) {
+    result = find_blocking(ctx, &targetX, &targetY, 'o');
     if(result <= 0)  {
-      result = closest_reachable(agent.location,
+      result = closest_reachable(ctx, ctx->agent.location,
         &targetX, &targetY, 'o');
     }
     //path to a blocking item if one is found
     if(result < 0) {
-      action = search_setup(targetX, targetY, LAND);
+      action = search_setup(ctx, targetX, targetY, LAND);
     }
   }
   return action;
@@ -294,69 +443,22 @@ char clear_path(void) {
 
 //Search for a space which could be blocking us from exploring further.
 //A blocking space is defined as an space of the given char
-//within 2 spaces of an unseen space
-
-int find_blocking(Coords agentLocation, int *x,
-  int *y, char blocker) {
-
-  Coords spaces[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int seen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  spaces[0].x = agentLocation.x;
-  spaces[0].y = agentLocation.y;
-
-  int counter = 1;
-  int i, j;
-//explore radially outwards from the agent's current position
-  for(i = 0; i < counter; i++) {
-    for(j = 0; j < 4; j++) {
-      int dir = (agent.direction + j) % 4; 
-      int forwardX, forwardY;
-      result_of_move(spaces[i].x, spaces[i].y, dir,
-        &forwardX, &forwardY);
-      //if we have already tested this space, skip it.
-      if(seen[forwardY][forwardX] == 1) continue;
-      //if we find a blocker within 2 of an unseen space,
-      //return it's location and it's distance away from the agent
-      //to be mapped to
-      if(Wmap[forwardY][forwardX] == blocker) {
-        int blockerDir;
-        for(blockerDir = 0; blockerDir < 4; blockerDir++) {
-          int blockerX, blockerY;
-          result_of_move(forwardX, forwardY, blockerDir,
-            &blockerX, &blockerY);
-          bool passCondition = false;
-          if(blocker == '~') {
-            if(Wmap[blockerY][blockerX] == '~' && 
-              adjacent_to(blockerY, blockerX, 0) != -1) {
-              passCondition = true;
-            }
-          } else if ((is_impassable_island_time(Wmap[blockerY][blockerX]) == 0) &&
-            adjacent_to(blockerY, blockerX, 0) != -1) {
-            passCondition = true;
-          }
-          if(passCondition == true) {
-            *x = forwardX;
-            *y = forwardY;
-            return adjusted_manhattan_dist(forwardX, forwardY,
-              agentLocation.x, agentLocation.y, agent.direction);
-          }
-        }
-      }
-      //otherwise if the space is passable add it to the queue of spaces to be search from.
-      if(is_impassable(Wmap[forwardY][forwardX]) == 0) {
-        spaces[counter].x = forwardX;
-        spaces[counter].y = forwardY;
-        seen[forwardY][forwardX] = 1;
-        counter++;
-      }
-    }
+//within 2 spaces of an unseen space (see survey_matches()).
+//Returns the cost of reaching the closest one, or -1 if there isn't one
+int find_blocking(AgentContext *ctx, int *x, int *y, char blocker) {
+  switch(blocker) {
+    case '~':
+      return survey_nearest(ctx, GOAL_BLOCKING_WATER, x, y);
+    case 'T':
+      return survey_nearest(ctx, GOAL_BLOCKING_TREE, x, y);
+    default:
+      return survey_nearest(ctx, GOAL_BLOCKING_STONE, x, y);
   }
-  return -1;
 }
 
 //Collect the appropriate items for the planned island hop and then
 //move to the chosen port for the current island to begin water traversal
-char prepare_for_island_hop(void) {
+char prepare_for_island_hop(AgentContext *ctx) {
   int targetX, targetY;
   int forwardX, forwardY;
   int maxCost;
@@ -364,50 +466,48 @@ char prepare_for_island_hop(void) {
 
   //if we need more stones to complete the trip, collect them
   //prioritising rocks which may be blocking further exploration
-  if(ic.stonesNeeded && ic.stonesNeeded > agent.stones) {
-    maxCost = find_blocking(agent.location,
-      &targetX, &targetY, 'o');
+  if(ctx->ic.stonesNeeded && ctx->ic.stonesNeeded > ctx->agent.stones) {
+    maxCost = find_blocking(ctx, &targetX, &targetY, 'o');
     if(maxCost <= 0) {
-      maxCost = closest_reachable(agent.location,
+      maxCost = closest_reachable(ctx, ctx->agent.location,
         &targetX, &targetY, 'o');
     }
     if(maxCost > 0) {
-      action = search_setup(targetX, targetY, LAND);
+      action = search_setup(ctx, targetX, targetY, LAND);
     }
   }
   //if we need a raft to complete the trip, collect one.
   //prioritising a tree which may be blocking further exploration
-  if(action == 0 && ic.raftNeeded && !agent.raft) {
-    maxCost = find_blocking(agent.location,
-      &targetX, &targetY, 'T');
+  if(action == 0 && ctx->ic.raftNeeded && !ctx->agent.raft) {
+    maxCost = find_blocking(ctx, &targetX, &targetY, 'T');
     if(maxCost <= 0) {
-      maxCost = closest_reachable(agent.location,
+      maxCost = closest_reachable(ctx, ctx->agent.location,
         &targetX, &targetY, 'T');
     }
     if(maxCost > 0) {
-      action = search_setup(targetX, targetY, LAND);
+      action = search_setup(ctx, targetX, targetY, LAND);
     }
   }
   //Once we have the appropriate resources move to the port
   if(action == 0) {
-    maxCost = adjusted_manhattan_dist(ic.homePort.x, ic.homePort.y, 
-      agent.location.x, agent.location.y, agent.direction);
+    maxCost = adjusted_manhattan_dist(ctx->ic.homePort.x, ctx->ic.homePort.y, 
+      ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction);
     if(maxCost > 0) {
-      action = search_setup(ic.homePort.x, ic.homePort.y, LAND);
+      action = search_setup(ctx, ctx->ic.homePort.x, ctx->ic.homePort.y, LAND);
     }
   } 
   //once we are at the port, change stage to signify that we have begun
   //water crossing and make the first water traversal action
   if(action == 0) {
-    ic.stage = WATER_CROSSING_TO_ISLAND; 
-    action = search_setup(ic.islandPort.x, ic.islandPort.y, WATER);
-    result_of_move(agent.location.x, agent.location.y, 
-      agent.direction, &forwardX, &forwardY);
+    ctx->ic.stage = WATER_CROSSING_TO_ISLAND; 
+    action = search_setup(ctx, ctx->ic.islandPort.x, ctx->ic.islandPort.y, WATER);
+    result_of_move(ctx->agent.location.x, ctx->agent.location.y, 
+      ctx->agent.direction, &forwardX, &forwardY);
 
     //if this action would put us on the new island, change islandNum to signify
     //we have finished island hopping.
-    if(action == 'f' && forwardY == ic.islandPort.y &&
-      forwardX == ic.islandPort.x) ic.islandNum = -1;
+    if(action == 'f' && forwardY == ctx->ic.islandPort.y &&
+      forwardX == ctx->ic.islandPort.x) ctx->ic.islandNum = -1;
 
   } 
   return action;  
@@ -415,83 +515,84 @@ char prepare_for_island_hop(void) {
 
 //Once we have reached port (or are on a raft) we can simply map
 //across the water to the chosen island's closest port
-char water_crossing(void) {
+char water_crossing(AgentContext *ctx) {
   int forwardX, forwardY;
   char action = 0;
-  action = search_setup(ic.islandPort.x, ic.islandPort.y, WATER);
-  result_of_move(agent.location.x, agent.location.y,
-    agent.direction, &forwardX, &forwardY);
+  action = search_setup(ctx, ctx->ic.islandPort.x, ctx->ic.islandPort.y, WATER);
+  result_of_move(ctx->agent.location.x, ctx->agent.location.y,
+    ctx->agent.direction, &forwardX, &forwardY);
 
     //if this action would put us on the new island, change islandNum to signify
   //we have finished island hopping.
-  if(action == 'f' && forwardY == ic.islandPort.y && 
-    forwardX == ic.islandPort.x) {
-    ic.islandNum = -1;
-    ic.stage = -1;
+  if(action == 'f' && forwardY == ctx->ic.islandPort.y && 
+    forwardX == ctx->ic.islandPort.x) {
+    ctx->ic.islandNum = -1;
+    ctx->ic.stage = -1;
   }
   return action;
 }
 
 //updates the players coords and direction to account for upcoming action
-void update_agent(char action) {
+void update_agent(AgentContext *ctx, char action) {
+  survey_invalidate(ctx);
   switch(action) {
     case 'f': case 'F':
       //how moving forward effects the agent depends on the direction it's facing.
-      switch(agent.direction) {
+      switch(ctx->agent.direction) {
         case UP: 
-          agent.location.y--;
+          ctx->agent.location.y--;
           break;
         case DOWN:
-          agent.location.y++;
+          ctx->agent.location.y++;
           break;
         case LEFT:
-          agent.location.x--;
+          ctx->agent.location.x--;
           break;
         case RIGHT:
-          agent.location.x++;
+          ctx->agent.location.x++;
           break;
         default:
           perror("direction out of range\n");
           exit(0);
       }
       //saving information if we have collected a new item (or used a depletable one)
-      if(view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == '$') {
-        agent.gold = true;
+      if(ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == '$') {
+        ctx->agent.gold = true;
       }
-      if(view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'a') {
-        agent.axe = true;
+      if(ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'a') {
+        ctx->agent.axe = true;
       }
-      if(view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'k') {
-        agent.key = true;
+      if(ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'k') {
+        ctx->agent.key = true;
       }
-      if(view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'o') {
-        agent.stones++;
+      if(ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'o') {
+        ctx->agent.stones++;
       }
-      if(view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == '~') {
-        if(agent.stones > 0) agent.stones--;
-        else  agent.currentlyRafting = true;
+      if(ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == '~') {
+        if(ctx->agent.stones > 0) ctx->agent.stones--;
+        else  ctx->agent.currentlyRafting = true;
       }
       //save whether or not we are currently on a raft
-      if(view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW]
-        != '~' && agent.currentlyRafting == true) {
+      if(ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW]
+        != '~' && ctx->agent.currentlyRafting == true) {
 
-        agent.raft = false;
-        agent.currentlyRafting = false;
+        ctx->agent.raft = false;
+        ctx->agent.currentlyRafting = false;
       }
       break;
     //saving directional changes
     case 'r': case 'R':
-      agent.direction++;
-      agent.direction = agent.direction % 4;
+      ctx->agent.direction++;
+      ctx->agent.direction = ctx->agent.direction % 4;
       break;
     case 'l': case 'L':
-      agent.direction--;
-      if(agent.direction < 0) agent.direction = LEFT;
+      ctx->agent.direction--;
+      if(ctx->agent.direction < 0) ctx->agent.direction = LEFT;
       break;
     case 'c': case 'C':
-      if(agent.axe == true &&
-        view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'T') {
-        agent.raft = true;
+      if(ctx->agent.axe == true &&
+        ctx->view[POS_AGENT_IN_VIEW -1][POS_AGENT_IN_VIEW] == 'T') {
+        ctx->agent.raft = true;
       }
       else {
         perror("trying to cut when unable (no axe or no tree)\n");
@@ -501,11 +602,71 @@ void update_agent(char action) {
   return;
 }
 
+//the agent is standing on a space. Anything it picked up there is gone
+void visit_space(AgentContext *ctx, int x, int y) {
+  if(been_at(ctx, x, y) == 0) {
+    set_been(ctx, x, y, 1);
+    frontier_update(ctx, find_cell(ctx, x, y));
+  }
+  if(wmap_at(ctx, x, y) == '~') {
+    set_island(ctx, x, y, -1);
+  } else if(wmap_at(ctx, x, y) != '#') {
+    change_space(ctx, x, y, '#');
+  }
+}
+
+//The change set. update_Wmap() writes only the spaces whose symbol differs from the map and records each one
+//(newly seen, changed from what we saw before, and whether it is now an item) along with what it was.
+//changes_apply() is then the one place the caches and indexes built on the map hear about it: the island sets,
+//the frontier sets, the cached plan, D* Lite and the survey. A turn that changes nothing (every turn, and most steps over ground
+//we have seen) leaves all of them as they were, so the crossing graph rows and the plan cache stay usable and
+//get_action() can take the speculative action.
+
+void changes_begin(AgentContext *ctx) {
+  ctx->changeSet.count = 0;
+  ctx->changeSet.ticks++;
+}
+
+//write a space's new symbol and add it to the change set
+void change_space(AgentContext *ctx, int x, int y, char symbol) {
+  assert(ctx->changeSet.count < MAX_CHANGES);
+  char oldSymbol = wmap_at(ctx, x, y);
+  int kind = oldSymbol == 0 ? CHANGE_SEEN : CHANGE_SYMBOL;
+  if(symbol == '$' || symbol == 'a' || symbol == 'k' || symbol == 'o') {
+    kind |= CHANGE_ITEM;
+  }
+  ctx->changeSet.spaces[ctx->changeSet.count].x = x;
+  ctx->changeSet.spaces[ctx->changeSet.count].y = y;
+  ctx->changeSet.oldSymbols[ctx->changeSet.count] = oldSymbol;
+  ctx->changeSet.kinds[ctx->changeSet.count++] = kind;
+  set_wmap(ctx, x, y, symbol);
+}
+
+//tell everything built on the map about the change set
+void changes_apply(AgentContext *ctx) {
+  if(ctx->changeSet.count == 0) {
+    ctx->changeSet.emptyTicks++;
+    return;
+  }
+  int i;
+  for(i = 0; i < ctx->changeSet.count; i++) {
+    int x = ctx->changeSet.spaces[i].x;
+    int y = ctx->changeSet.spaces[i].y;
+    islands_symbol_changed(ctx, find_cell(ctx, x, y), ctx->changeSet.oldSymbols[i], wmap_at(ctx, x, y));
+    frontier_space_changed(ctx, x, y);
+    space_changed(ctx, x, y);
+    if(ctx->changeSet.kinds[i] & CHANGE_SEEN) ctx->changeSet.seen++;
+    else ctx->changeSet.changed++;
+    if(ctx->changeSet.kinds[i] & CHANGE_ITEM) ctx->changeSet.items++;
+  }
+  survey_invalidate(ctx);
+}
+
 //adjusts a direction vector x,y to account for the orientation of the agent in the world map.
-void adjust_dir_vector(int *x, int *y) {
+void adjust_dir_vector(AgentContext *ctx, int *x, int *y) {
   int tmp;
   //applies the effect of the appropriate rotation matrix to the vector
-  switch(agent.direction) {
+  switch(ctx->agent.direction) {
     case UP:
       break;
     case RIGHT:
@@ -532,7 +693,8 @@ void adjust_dir_vector(int *x, int *y) {
 }
 
 //adds the agent's current view to the world map
-void update_Wmap(char view[5][5]) {
+void update_Wmap(AgentContext *ctx, char view[5][5]) {
+  changes_begin(ctx);
   int yCount, xCount;
   for(yCount = 0; yCount < 5; yCount++) {
     //as we know where the agent is on the world map we can convert what it is seeing to map coords.
@@ -541,48 +703,47 @@ void update_Wmap(char view[5][5]) {
       int yVec = yCount - POS_AGENT_IN_VIEW;
       int xVec = xCount - POS_AGENT_IN_VIEW;
       //adjust the direction vector to the world map.
-      adjust_dir_vector(&xVec, &yVec);
-      int mapXCoord = agent.location.x + xVec;
-      int mapYCoord = agent.location.y + yVec;
+      adjust_dir_vector(ctx, &xVec, &yVec);
+      int mapXCoord = ctx->agent.location.x + xVec;
+      int mapYCoord = ctx->agent.location.y + yVec;
       //if the current view contains a useful item, save its coordinates
       switch(view[yCount][xCount]) {
         case '$':
-          agent.seenGold.x = mapXCoord;
-          agent.seenGold.y = mapYCoord;
+          ctx->agent.seenGold.x = mapXCoord;
+          ctx->agent.seenGold.y = mapYCoord;
           break;
         case 'a':
-          agent.seenAxe.x = mapXCoord;
-          agent.seenAxe.y = mapYCoord;
+          ctx->agent.seenAxe.x = mapXCoord;
+          ctx->agent.seenAxe.y = mapYCoord;
           break;
         case 'k':
-          agent.seenKey.x = mapXCoord;
-          agent.seenKey.y = mapYCoord;
+          ctx->agent.seenKey.x = mapXCoord;
+          ctx->agent.seenKey.y = mapYCoord;
           break;
       }
      
       //record which spaces the agent has visited
       //# is used to differentiate empty spaces we have seen
       //from those we havent..
-      if(mapYCoord == agent.location.y &&
-        mapXCoord == agent.location.x) {
+      if(mapYCoord == ctx->agent.location.y &&
+        mapXCoord == ctx->agent.location.x) {
 
-        placesBeen[agent.location.y][agent.location.x] = 1;
-        if(Wmap[mapYCoord][mapXCoord] == '~') {
-          islandMap[mapYCoord][mapXCoord] = -1;
-        } else Wmap[mapYCoord][mapXCoord] = '#';
+        visit_space(ctx, mapXCoord, mapYCoord);
         continue;
       } 
-      else if(view[yCount][xCount] == ' ' ||
-        view[yCount][xCount] == 'O') {
-        Wmap[mapYCoord][mapXCoord] = '#';
+      char seen = view[yCount][xCount];
+      if(seen == ' ' || seen == 'O') seen = '#';
+      if(wmap_at(ctx, mapXCoord, mapYCoord) != seen) {
+        change_space(ctx, mapXCoord, mapYCoord, seen);
       }
-      else Wmap[mapYCoord][mapXCoord] = view[yCount][xCount];
     }
   }
+  //anything planned using the spaces that changed needs to know
+  changes_apply(ctx);
   return;
 }
 
-void print_view()
+void print_view(AgentContext *ctx)
 {
   int i,j;
 
@@ -594,7 +755,7 @@ void print_view()
         putchar( '^' );
       }
       else {
-        putchar( view[i][j] );
+        putchar( ctx->view[i][j] );
       }
     }
     printf("|\n");
@@ -602,17 +763,20 @@ void print_view()
   printf("+-----+\n");
 }
 
+#ifndef AGENT_NO_MAIN
 int main( int argc, char *argv[] )
 {
   char action;
   int sd;
   int ch;
   int i,j;
+  char nextView[5][5] = {{0}};
 
   if ( argc < 3 ) {
     printf("Usage: %s -p port\n", argv[0] );
     exit(1);
   }
+  AgentContext *ctx = agent_new();
 
     // open socket to Game Engine
   sd = tcpopen("localhost", atoi( argv[2] ));
@@ -628,21 +792,35 @@ int main( int argc, char *argv[] )
         if( !(( i == 2 )&&( j == 2 ))) {
           ch = getc( in_stream );
           if( ch == -1 ) {
+            speculation_wait(ctx);
+#ifdef AGENT_STATS
+            print_plan_stats(ctx, stderr);
+            print_workspace_stats(ctx, stderr);
+            print_map_stats(ctx, stderr);
+            print_deadline_stats(ctx, stderr);
+            print_speculation_stats(ctx, stderr);
+#endif
             exit(1);
           }
-          view[i][j] = ch;
+          nextView[i][j] = ch;
         }
       }
     }
 
+    //the view is only handed over once the planner thread is done with the world
+    speculation_wait(ctx);
+    memcpy(ctx->view, nextView, sizeof(ctx->view));
     //print_view(); // COMMENT THIS OUT BEFORE SUBMISSION
-    action = get_action( view );
+    action = get_action(ctx,  ctx->view );
     putc( action, out_stream );
     fflush( out_stream );
+    //plan the next turn while the engine works out this one
+    speculation_start(ctx);
   }
 
   return 0;
 }
+#endif
 
 //returns the square the agent would occupy if it was to move forward
 //from a given square facing a given directon
@@ -669,133 +847,270 @@ void result_of_move(int xPos, int yPos, int dir,
   return;
 }
 
-//creates a map of every island seen by the agent
-//done by finding a passable space and floodfilling all passable spaces around it
-//each floodfilled section is it's own island. 
-int create_islandMap(Coords agentLocation,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP], 
-  Island islandsInfo[40]) {
-
-  reset(islandMap);
-  Coords spaces[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int seen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  int islandCounter = 1;
-  int i,dir;
-
-  while(find_island(agentLocation, islandMap, &(spaces[0].x),
-    &(spaces[0].y))) {
-    //for each new island found we set up a Island struct in islandsInfo
-    //with all gathered information, used to determine how valuable it
-    //is to travel to this island
-    islandMap[spaces[0].y][spaces[0].x] = islandCounter;
-    int islandIdx = islandCounter - 1;
-    islandsInfo[islandIdx].firstSpaceSeen.x = spaces[0].x;
-    islandsInfo[islandIdx].firstSpaceSeen.y = spaces[0].y;
-    islandsInfo[islandIdx].returnSquare = false;
-    islandsInfo[islandIdx].gold = false;
-    islandsInfo[islandIdx].tree = false;
-    islandsInfo[islandIdx].key = false;
-    islandsInfo[islandIdx].axe = false;
-    islandsInfo[islandIdx].stones = 0;
-    seen[spaces[0].y][spaces[0].x] = 1;
-
-    if(Wmap[spaces[0].y][spaces[0].x] == '~') {
-      islandCounter++;
-      continue;
-    }
-    int i,j;
-    int counter = 1;
-    //we flood fill to search every passable square to collect all important information
-    //about the island (shape, items etc.)
-    for(i = 0; i < counter; i++) {
-      if(spaces[i].y == AGENT_START && spaces[i].x == AGENT_START) {
-        islandsInfo[islandIdx].returnSquare = true;
-      }
-      switch (Wmap[spaces[i].y][spaces[i].x]) {
-        case '$':
-          islandsInfo[islandIdx].gold = true;
-          break;
-        case 'T':
-          islandsInfo[islandIdx].tree = true;
-          break;
-        case 'k':
-          islandsInfo[islandIdx].key = true;
-          break;
-        case 'a':
-          islandsInfo[islandIdx].axe = true;
-          break;
-        case 'o':
-          islandsInfo[islandIdx].stones++;
+//numbers every island seen by the agent in islandsInfo and labels the world map with the numbers.
+//The agent's own island is first (on a raft that is just the water it is on), then every other island
+//with a space next to water in the order a scan radially outwards from the agent reaches them.
+//The islands themselves are kept up to date by the island sets as spaces are seen, so this is a single
+//scan rather than a flood fill per island
+int create_islandMap(AgentContext *ctx, Coords agentLocation) {
+  islands_sync(ctx);
+  if(ctx->islandSets.count + 1 > ctx->islandsCapacity) {
+    ctx->islandsCapacity = ctx->islandsCapacity ? ctx->islandsCapacity * 2 : INITIAL_ISLANDS;
+    while(ctx->islandsCapacity < ctx->islandSets.count + 1) ctx->islandsCapacity *= 2;
+    ctx->islandsInfo = realloc(ctx->islandsInfo, ctx->islandsCapacity * sizeof(Island));
+    assert(ctx->islandsInfo != NULL);
+  }
+  int i;
+  for(i = 0; i < ctx->islandSets.numSets; i++) ctx->islandSets.sets[i].number = 0;
+  int numIslands = 0;
+  island_number(ctx, agentLocation, &numIslands);
+
+  Workspace *ws = acquire_workspace(ctx);
+  BitRegion *frontier = &ws->regions[0];
+  BitRegion *discovered = &ws->regions[1];
+  BitRegion *next = &ws->regions[2];
+  region_clear(ctx, frontier);
+  region_clear(ctx, discovered);
+  region_add(ctx, frontier, agentLocation.x, agentLocation.y);
+  region_add(ctx, discovered, agentLocation.x, agentLocation.y);
+  //scan radially outwards from the agent through every space we have seen, a layer at a time
+  while(true) {
+    region_step(ctx, frontier, discovered, next);
+    if(!region_mask(ctx, next, PASS_SEEN)) break;
+    //a new island must have a space adjacent to water, this stops an unreachable island
+    //(e.g. surrounded by stones) from being considered
+    int count = region_spaces(ctx, next, NO_PLANE, ws->spaces);
+    int ports = 0;
+    for(i = 0; i < count; i++) {
+      int root = island_find(ctx, find_cell(ctx, ws->spaces[i].x, ws->spaces[i].y));
+      if(root != NO_CELL && ctx->islandSets.sets[ctx->world.islandSet[root]].number == 0 &&
+        adjacent_to(ctx, ws->spaces[i].y, ws->spaces[i].x, '~') != -1) {
+        ws->spaces[ports++] = ws->spaces[i];
       }
-      for(j = 0; j < 4; j++) {
-        int dir = (agent.direction + j) % 4; 
-        int forwardX, forwardY;
-        result_of_move(spaces[i].x, spaces[i].y, dir,
-          &forwardX, &forwardY);
-        if(seen[forwardY][forwardX] == 1) continue;
-        if(is_impassable_island_time(Wmap[forwardY][forwardX]) == 0) {
-          spaces[counter].x = forwardX;
-          spaces[counter].y = forwardY;
-          islandMap[forwardY][forwardX] = islandCounter;
-          seen[forwardY][forwardX] = 1;
-          counter++;
+    }
+    //number the islands first reached in this layer, the one with the closest space first
+    while(true) {
+      int closest = MAX_DIST;
+      int port = -1;
+      for(i = 0; i < ports; i++) {
+        int root = island_find(ctx, find_cell(ctx, ws->spaces[i].x, ws->spaces[i].y));
+        if(ctx->islandSets.sets[ctx->world.islandSet[root]].number != 0) continue;
+        int dist = adjusted_manhattan_dist(ws->spaces[i].x, ws->spaces[i].y,
+          agentLocation.x, agentLocation.y, ctx->agent.direction);
+        if(dist < closest) {
+          closest = dist;
+          port = i;
         }
       }
+      if(port == -1) break;
+      island_number(ctx, ws->spaces[port], &numIslands);
     }
-    islandCounter++;
+    BitRegion *swap = frontier;
+    frontier = next;
+    next = swap;
+  }
+  release_workspace(ctx, ws);
+
+  int cell;
+  for(cell = 0; cell < ctx->world.numTiles * TILE_CELLS; cell++) {
+    int root = island_find(ctx, cell);
+    ctx->world.islands[cell] = root == NO_CELL ? 0 :
+      ctx->islandSets.sets[ctx->world.islandSet[root]].number;
+  }
+  if(island_find(ctx, find_cell(ctx, agentLocation.x, agentLocation.y)) == NO_CELL) {
+    set_island(ctx, agentLocation.x, agentLocation.y, 1);
   }
-  return islandCounter - 1;
+  return numIslands;
 }
 
-//scans outwards radially from the agent to find passable spaces which are not adjacent
-//to any other island i.e. a new island
-//we then floodfill from this space in creat_islandMap()
-bool find_island(Coords agentLocation,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP], 
-  int *islandX, int *islandY) {
+//give the island a space is on the next number and set up its Island struct in islandsInfo
+//with all gathered information, used to determine how valuable it is to travel to this island
+void island_number(AgentContext *ctx, Coords space, int *numIslands) {
+  Island *info = &ctx->islandsInfo[(*numIslands)++];
+  info->firstSpaceSeen = space;
+  int root = island_find(ctx, find_cell(ctx, space.x, space.y));
+  if(root == NO_CELL) {
+    info->returnSquare = space.x == AGENT_START && space.y == AGENT_START;
+    info->gold = info->tree = info->key = info->axe = false;
+    info->stones = 0;
+    return;
+  }
+  IslandSet *set = &ctx->islandSets.sets[ctx->world.islandSet[root]];
+  set->number = *numIslands;
+  info->returnSquare = set->returnSquare;
+  info->gold = set->gold > 0;
+  info->tree = set->trees > 0;
+  info->key = set->keys > 0;
+  info->axe = set->axes > 0;
+  info->stones = set->stones;
+}
 
-  if(islandMap[agentLocation.y][agentLocation.x] == 0) {
-    *islandX = agentLocation.x;
-    *islandY = agentLocation.y;
-    return 1;
+//The island sets group every space that is passable at island time (see is_impassable_island_time())
+//into islands with a union-find. Spaces only ever become passable as the agent explores (water gets
+//stepping stones, doors are unlocked, items are picked up), so each space seen by update_Wmap() just
+//joins the islands next to it. Each island keeps count of what is on it as spaces join and change.
+//A new tool changes which spaces are passable, so the sets are then built again from the map.
+
+//island_find() without the path halving, for the threads that only read the island sets
+int island_root(AgentContext *ctx, int cell) {
+  if(cell == NO_CELL || ctx->world.islandParent[cell] == 0) return NO_CELL;
+  while(ctx->world.islandParent[cell] - 1 != cell) cell = ctx->world.islandParent[cell] - 1;
+  return cell;
+}
+
+//the root of the island a space is on, or NO_CELL if it isn't on one
+int island_find(AgentContext *ctx, int cell) {
+  if(cell == NO_CELL || ctx->world.islandParent[cell] == 0) return NO_CELL;
+  while(ctx->world.islandParent[cell] - 1 != cell) {
+    //path halving, every space on the way is pointed at its grandparent
+    int parent = ctx->world.islandParent[cell] - 1;
+    ctx->world.islandParent[cell] = ctx->world.islandParent[parent];
+    cell = ctx->world.islandParent[cell] - 1;
   }
+  return cell;
+}
 
-  Coords spaces[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int seen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  spaces[0].x = agentLocation.x;
-  spaces[0].y = agentLocation.y;
-  seen[spaces[0].y][spaces[0].x] = 1;
-  int i,j;
-  int counter = 1;
-  //scans radially outwards from the agent
-  for(i = 0; i < counter; i++) {
-    for(j = 0; j < 4; j++) {
-      int dir = (agent.direction + j) % 4; 
-      int forwardX, forwardY;
-      result_of_move(spaces[i].x, spaces[i].y, dir,
-        &forwardX, &forwardY);
-      if(out_of_bounds(forwardX, forwardY, DOUBLE_MAX_MAP)) continue;
-      //stones and trees (if we have an axe) are treated as passable so we do not miss an island
-      if(is_impassable_island_time(Wmap[forwardY][forwardX]) == false &&
-        islandMap[forwardY][forwardX] == 0 && 
-        adjacent_to(forwardY, forwardX, '~') != -1) {
-        //new island must have a space adjacent to water, this stops an unreachable island
-        //(e.g. surrounded by stones) from being considered
-        *islandX = forwardX;
-        *islandY = forwardY;
-        return 1; 
-      }
-      if(seen[forwardY][forwardX] == 1 ||
-        Wmap[forwardY][forwardX] == 0) continue;
-      else {
-        spaces[counter].x = forwardX;
-        spaces[counter].y = forwardY;
-        seen[forwardY][forwardX] = 1;
-        counter++;
-      }
+//start a new island with just this space on it. Returns its set
+int new_island_set(AgentContext *ctx, int cell) {
+  int index = ctx->islandSets.freeSets;
+  if(index != NO_SET) {
+    ctx->islandSets.freeSets = ctx->islandSets.sets[index].nextFree;
+  } else {
+    if(ctx->islandSets.numSets == ctx->islandSets.capacity) {
+      ctx->islandSets.capacity = ctx->islandSets.capacity ? ctx->islandSets.capacity * 2 :
+        INITIAL_ISLANDS;
+      ctx->islandSets.sets = realloc(ctx->islandSets.sets,
+        ctx->islandSets.capacity * sizeof(IslandSet));
+      assert(ctx->islandSets.sets != NULL);
     }
+    index = ctx->islandSets.numSets++;
+  }
+  IslandSet *set = &ctx->islandSets.sets[index];
+  memset(set, 0, sizeof(IslandSet));
+  set->live = true;
+  set->root = cell;
+  set->size = 1;
+  set->nextFree = NO_SET;
+  ctx->islandSets.count++;
+  ctx->world.islandParent[cell] = cell + 1;
+  ctx->world.islandSet[cell] = index;
+  return index;
+}
+
+//add a space that has become passable, joining it to any islands next to it
+void island_join(AgentContext *ctx, int cell) {
+  int index = new_island_set(ctx, cell);
+  IslandSet *set = &ctx->islandSets.sets[index];
+  int x = cell_x(ctx, cell);
+  int y = cell_y(ctx, cell);
+  island_count(set, ctx->world.symbols[cell], 1);
+  if(x == AGENT_START && y == AGENT_START) set->returnSquare = true;
+  int dir;
+  for(dir = 0; dir < 4; dir++) {
+    int forwardX, forwardY;
+    result_of_move(x, y, dir, &forwardX, &forwardY);
+    int neighbour = island_find(ctx, find_cell(ctx, forwardX, forwardY));
+    if(neighbour != NO_CELL) island_union(ctx, cell, neighbour);
+  }
+}
+
+//merge the islands two spaces are on, the smaller one into the larger
+void island_union(AgentContext *ctx, int a, int b) {
+  a = island_find(ctx, a);
+  b = island_find(ctx, b);
+  if(a == b) return;
+  IslandSet *into = &ctx->islandSets.sets[ctx->world.islandSet[a]];
+  IslandSet *from = &ctx->islandSets.sets[ctx->world.islandSet[b]];
+  if(into->size < from->size) {
+    IslandSet *swap = into;
+    into = from;
+    from = swap;
+  }
+  ctx->world.islandParent[from->root] = into->root + 1;
+  into->size += from->size;
+  into->gold += from->gold;
+  into->trees += from->trees;
+  into->axes += from->axes;
+  into->keys += from->keys;
+  into->stones += from->stones;
+  into->returnSquare = into->returnSquare || from->returnSquare;
+  from->live = false;
+  from->nextFree = ctx->islandSets.freeSets;
+  ctx->islandSets.freeSets = ctx->world.islandSet[from->root];
+  ctx->islandSets.count--;
+  ctx->islandSets.unions++;
+}
+
+//add (sign 1) or remove (sign -1) what a symbol puts on an island
+void island_count(IslandSet *set, char symbol, int sign) {
+  switch(symbol) {
+    case '$':
+      set->gold += sign;
+      break;
+    case 'T':
+      set->trees += sign;
+      break;
+    case 'k':
+      set->keys += sign;
+      break;
+    case 'a':
+      set->axes += sign;
+      break;
+    case 'o':
+      set->stones += sign;
+  }
+}
+
+//called by changes_apply() once a space's symbol has changed
+void islands_symbol_changed(AgentContext *ctx, int cell, char oldSymbol, char newSymbol) {
+  //the crossings between islands only change if where we can walk or sail does
+  if(is_impassable(ctx, oldSymbol) != is_impassable(ctx, newSymbol) ||
+    is_impassable_island_time(ctx, oldSymbol) != is_impassable_island_time(ctx, newSymbol) ||
+    (oldSymbol == '~') != (newSymbol == '~')) {
+    ctx->islandSets.revision++;
+  }
+  if(ctx->islandSets.stale || ctx->islandSets.axe != ctx->agent.axe || ctx->islandSets.key != ctx->agent.key) {
+    ctx->islandSets.stale = true;
+    return;
+  }
+  int root = island_find(ctx, cell);
+  if(root != NO_CELL) {
+    //a space only becomes impassable if what we saw of it was wrong, so just start again
+    if(is_impassable_island_time(ctx, newSymbol)) {
+      ctx->islandSets.stale = true;
+      return;
+    }
+    IslandSet *set = &ctx->islandSets.sets[ctx->world.islandSet[root]];
+    island_count(set, oldSymbol, -1);
+    island_count(set, newSymbol, 1);
+  } else if(!is_impassable_island_time(ctx, newSymbol)) {
+    island_join(ctx, cell);
+  }
+}
+
+//build the island sets from scratch for the agent's current tools
+void islands_rebuild(AgentContext *ctx) {
+  memset(ctx->world.islandParent, 0, NUM_CELLS * sizeof(int));
+  ctx->islandSets.count = 0;
+  ctx->islandSets.numSets = 0;
+  ctx->islandSets.freeSets = NO_SET;
+  ctx->islandSets.axe = ctx->agent.axe;
+  ctx->islandSets.key = ctx->agent.key;
+  ctx->islandSets.stale = false;
+  ctx->islandSets.rebuilds++;
+  ctx->islandSets.revision++;
+  int cell;
+  for(cell = 0; cell < ctx->world.numTiles * TILE_CELLS; cell++) {
+    if(!is_impassable_island_time(ctx, ctx->world.symbols[cell])) island_join(ctx, cell);
+  }
+}
+
+//make sure the island sets match the agent's tools before they are used
+void islands_sync(AgentContext *ctx) {
+  if(ctx->islandSets.stale || ctx->islandSets.axe != ctx->agent.axe ||
+    ctx->islandSets.key != ctx->agent.key) {
+    islands_rebuild(ctx);
   }
-  return 0;
 }
 
 //given a list of islands discovered during create_islandMap()
@@ -811,8 +1126,9 @@ bool find_island(Coords agentLocation,
 //7. island with tool but no guaranteed return
 //8. any island 
 //an island with guaranteed return is defined as being reachable using stones or containing a tree (if we have an axe)
-void choose_island(int numIslands, Island islandsInfo[40],
-  IslandCrossing *ic, int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]) {
+//Once we have seen the gold, plan_hops() looks for a whole trip there and back first and the order above is the fallback.
+void choose_island(AgentContext *ctx, int numIslands,
+  Island islandsInfo[], IslandCrossing *ic) {
 
   int targetX;
   int targetY;
@@ -825,38 +1141,40 @@ void choose_island(int numIslands, Island islandsInfo[40],
   int raftNeeded = false;
   //no point picking an island if there is only 1
   if(numIslands < 2) return;
+  plan_crossings(ctx, numIslands);
+  //0. the first hop of the cheapest way we can see to get the gold and bring it home
+  if(plan_hops(ctx, numIslands, ic)) return;
   //1. Initial island if we already have the gold
-  if(non_return_island_check(numIslands, ic, islandsInfo, islandMap,
+  if(non_return_island_check(ctx, numIslands, ic, islandsInfo,
     RETURN_GOLD)) return;
   //2. island with gold and a return route
-  if(return_island_check(numIslands, ic, islandsInfo, islandMap,
+  if(return_island_check(ctx, numIslands, ic, islandsInfo,
     GOLD)) return;
   //3. island wih tool we don't yet have and a return route
-  if(return_island_check(numIslands, ic, islandsInfo, islandMap, 
+  if(return_island_check(ctx, numIslands, ic, islandsInfo, 
     TOOL)) return;
   //4. island containing more or equal stones than it would take to get there
-  if(stone_island_check(numIslands, ic, islandsInfo, islandMap)) {
+  if(stone_island_check(ctx, numIslands, ic, islandsInfo)) {
     return;
   }
   //5. any island with guaranteed return
-  if(return_island_check(numIslands, ic, islandsInfo, islandMap, 
+  if(return_island_check(ctx, numIslands, ic, islandsInfo, 
     OTHER)) return;
   //6. island with gold but no guaranteed return
-  if(non_return_island_check(numIslands, ic, islandsInfo, islandMap,
+  if(non_return_island_check(ctx, numIslands, ic, islandsInfo,
     GOLD)) return;
   //7. island with tool but no guaranteed return
-  if(non_return_island_check(numIslands, ic, islandsInfo, islandMap,
+  if(non_return_island_check(ctx, numIslands, ic, islandsInfo,
     TOOL)) return;
   //8. any island
-  if(non_return_island_check(numIslands, ic, islandsInfo, islandMap,
+  if(non_return_island_check(ctx, numIslands, ic, islandsInfo,
     OTHER)) return;
 }
 
 //Check if an island with the current requirement (type) exists and if it is reachable.
 //if so save this island and the path to this island as our current IslandCrossing.
-int non_return_island_check(int numIslands, IslandCrossing *ic,
-  Island islandsInfo[40],
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP], int type) {
+int non_return_island_check(AgentContext *ctx, int numIslands, IslandCrossing *ic,
+  Island islandsInfo[], int type) {
 
   int targetIsland;
   int targetX, targetY;
@@ -865,21 +1183,21 @@ int non_return_island_check(int numIslands, IslandCrossing *ic,
     int caseSwitch = false;
     switch (type) {
       case RETURN_GOLD:
-        if(islandsInfo[targetIsland].returnSquare && agent.gold) {
+        if(islandsInfo[targetIsland].returnSquare && ctx->agent.gold) {
           caseSwitch = true;
         }
         break;
 
       case GOLD:
         if(islandsInfo[targetIsland].gold &&
-          closest_reachable(islandsInfo[targetIsland].firstSpaceSeen,
+          closest_reachable(ctx, islandsInfo[targetIsland].firstSpaceSeen,
           &targetX, &targetY, UNSEEN) != -1) caseSwitch = true;
         break;
 
       case TOOL:
-        if(((islandsInfo[targetIsland].axe && !agent.axe) ||
-          (islandsInfo[targetIsland].key && !agent.key)) && 
-          closest_reachable(islandsInfo[targetIsland].firstSpaceSeen,
+        if(((islandsInfo[targetIsland].axe && !ctx->agent.axe) ||
+          (islandsInfo[targetIsland].key && !ctx->agent.key)) && 
+          closest_reachable(ctx, islandsInfo[targetIsland].firstSpaceSeen,
           &targetX, &targetY, UNSEEN) != -1) caseSwitch = true;
 
       default: 
@@ -890,11 +1208,11 @@ int non_return_island_check(int numIslands, IslandCrossing *ic,
     if(caseSwitch == true) {
       if(targetIsland != numIslands) {
         int targetX, targetY;
-        if((agent.raft || (islandsInfo[0].tree && agent.axe))) {
-          path_to_best_port(&(ic->islandPort.x), &(ic->islandPort.y),
+        if((ctx->agent.raft || (islandsInfo[0].tree && ctx->agent.axe))) {
+          path_to_best_port(ctx, &(ic->islandPort.x), &(ic->islandPort.y),
             &(ic->homePort.x), &(ic->homePort.y),
             islandsInfo[targetIsland].firstSpaceSeen,
-            islandsInfo[0].stones + agent.stones, 1, islandMap);
+            islandsInfo[0].stones + ctx->agent.stones, 1);
           //if we can reach the island, save the method we took to get there
           //and each end of the path (i.e. the port on the current island and the new island)
           if(ic->homePort.x != -1) {
@@ -906,11 +1224,11 @@ int non_return_island_check(int numIslands, IslandCrossing *ic,
         //returning gold is an edge case as we do not care about if we can return or not when using a raft
         //but we will not if it is reachable by stones previously in return_island_check(), so we must test this.
         } else if (type == RETURN_GOLD) {
-          if(islandsInfo[0].stones + agent.stones > 0) {
-            ic->stonesNeeded = path_to_best_port(&(ic->islandPort.x),
+          if(islandsInfo[0].stones + ctx->agent.stones > 0) {
+            ic->stonesNeeded = path_to_best_port(ctx, &(ic->islandPort.x),
               &(ic->islandPort.y), &(ic->homePort.x), &(ic->homePort.y),
               islandsInfo[targetIsland].firstSpaceSeen,
-              islandsInfo[0].stones + agent.stones, 0, islandMap);
+              islandsInfo[0].stones + ctx->agent.stones, 0);
 
             if(ic->homePort.x != -1) {
               ic->raftNeeded = false;
@@ -927,9 +1245,8 @@ int non_return_island_check(int numIslands, IslandCrossing *ic,
 
 //Check if an island with the current requirement (type) exists, if it is reachable and it has a guaranteed return.
 //if so save this island and the path to this island as our current IslandCrossing.
-int return_island_check(int numIslands, IslandCrossing *ic,
-  Island islandsInfo[40],
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP], int type) {
+int return_island_check(AgentContext *ctx, int numIslands, IslandCrossing *ic,
+  Island islandsInfo[], int type) {
   int targetIsland;
 
   //check to see if any island has the given requirement (type)
@@ -941,8 +1258,8 @@ int return_island_check(int numIslands, IslandCrossing *ic,
         break;
 
       case TOOL:
-        if((islandsInfo[targetIsland].axe && !agent.axe) 
-          || (islandsInfo[targetIsland].key && !agent.key)) {
+        if((islandsInfo[targetIsland].axe && !ctx->agent.axe) 
+          || (islandsInfo[targetIsland].key && !ctx->agent.key)) {
           caseSwitch = true;
         }
         break;
@@ -955,25 +1272,25 @@ int return_island_check(int numIslands, IslandCrossing *ic,
     if(caseSwitch == true) {
       if(targetIsland != numIslands) {
         //first we check if we have enough stones on the current island to reach the new island
-        if(islandsInfo[0].stones + agent.stones > 0) {
+        if(islandsInfo[0].stones + ctx->agent.stones > 0) {
           ic->raftNeeded = false;
-          ic->stonesNeeded = path_to_best_port(&(ic->islandPort.x),
+          ic->stonesNeeded = path_to_best_port(ctx, &(ic->islandPort.x),
             &(ic->islandPort.y), &(ic->homePort.x), &(ic->homePort.y),
             islandsInfo[targetIsland].firstSpaceSeen,
-            islandsInfo[0].stones + agent.stones, 0, islandMap);
+            islandsInfo[0].stones + ctx->agent.stones, 0);
         }
         if(ic->homePort.x != -1) {
           ic->islandNum = targetIsland + 1;
           return 1;
         //if we can't reach by stones, try by raft (if we have one or there is a tree we can cut down)
-        } else if((agent.raft ||
-          (islandsInfo[0].tree && agent.axe)) &&
+        } else if((ctx->agent.raft ||
+          (islandsInfo[0].tree && ctx->agent.axe)) &&
           islandsInfo[targetIsland].tree) {
 
-          path_to_best_port(&(ic->islandPort.x), &(ic->islandPort.y),
+          path_to_best_port(ctx, &(ic->islandPort.x), &(ic->islandPort.y),
             &(ic->homePort.x), &(ic->homePort.y),
             islandsInfo[targetIsland].firstSpaceSeen,
-            islandsInfo[0].stones + agent.stones, 1, islandMap);
+            islandsInfo[0].stones + ctx->agent.stones, 1);
 
           if(ic->homePort.x != -1) {
             ic->raftNeeded = true;
@@ -991,9 +1308,8 @@ int return_island_check(int numIslands, IslandCrossing *ic,
 //Check if an island takes less stones to reach than it has on the island.
 //if so we are gaining more stones to explore it than we lose to get there so
 //it's free real estate
-int stone_island_check(int numIslands, IslandCrossing *ic,
-  Island islandsInfo[40],
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]) {
+int stone_island_check(AgentContext *ctx, int numIslands, IslandCrossing *ic,
+  Island islandsInfo[]) {
 
   int targetIsland;
   int bestStoneValue = -1;
@@ -1004,11 +1320,11 @@ int stone_island_check(int numIslands, IslandCrossing *ic,
   //check if an island has stones and we have stones to travel to it
   for(targetIsland = 1; targetIsland < numIslands; targetIsland++) {
     if(islandsInfo[targetIsland].stones > 0) {
-      if(islandsInfo[0].stones + agent.stones > 0) {
-        stonesUsed = path_to_best_port(&(ic->islandPort.x),
+      if(islandsInfo[0].stones + ctx->agent.stones > 0) {
+        stonesUsed = path_to_best_port(ctx, &(ic->islandPort.x),
           &(ic->islandPort.y), &(ic->homePort.x), &(ic->homePort.y),
           islandsInfo[targetIsland].firstSpaceSeen,
-          islandsInfo[0].stones + agent.stones, 0, islandMap);
+          islandsInfo[0].stones + ctx->agent.stones, 0);
       }
       //if the island is reachable and the shortest path we found takes less stones
       //to traverse than there are stones on the island
@@ -1040,415 +1356,2381 @@ int stone_island_check(int numIslands, IslandCrossing *ic,
   return 0;
 }
 
-//For a chosen island attempt to path to the current island
-int path_to_best_port(int *bestTargetPortX, int *bestTargetPortY,
+//For a chosen island, look up the shortest crossing to it from the current island (see plan_crossings()).
+//The ports are only saved if the crossing can be made with the stones we have (or a raft).
+//Returns the stones the crossing would use
+int path_to_best_port(AgentContext *ctx, int *bestTargetPortX, int *bestTargetPortY,
   int *bestHomePortX,int *bestHomePortY, Coords startPos, int stones,
-  bool raft, int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]) {
-
-  Coords spaces[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int seen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  spaces[0].x = startPos.x;
-  spaces[0].y = startPos.y;
-  seen[spaces[0].y][spaces[0].x] = 1;
-  int bestPathLength = MAX_MAP * MAX_MAP;
-  int i,j;
-  int counter = 1;
-  int homePortX = -1; 
-  int homePortY = -1;
-  int stonesUsed;
-  int result = MAX_DIST;
-
-  int waterDir = adjacent_to(startPos.y, startPos.x, '~');
-  if(waterDir != -1) {
-    result = plan_water_path(startPos.x, startPos.y, waterDir, &homePortX, &homePortY, 1, stones, raft, islandMap);
-    if(result < bestPathLength && (result > 0 && is_reachable(agent.location, homePortX, homePortY)) || (result >= 0 && agent.currentlyRafting)) {
-      bestPathLength = result;
-      *bestTargetPortX = startPos.x;
-      *bestTargetPortY = startPos.y;
-      *bestHomePortX = homePortX;
-      *bestHomePortY = homePortY;
-    }  
-  }
-  for(i = 0; i < counter; i++) {
-    for(j = 0; j < 4; j++) {
-      int dir = j; 
-      int forwardX, forwardY;
-      result_of_move(spaces[i].x, spaces[i].y, dir,
-        &forwardX, &forwardY);
-      if(out_of_bounds(forwardX, forwardY, DOUBLE_MAX_MAP)) continue;
-      waterDir = adjacent_to(forwardY, forwardX, '~');
-      if(is_impassable_island_time(Wmap[forwardY][forwardX]) == false
-        && waterDir != -1) {
-       result = plan_water_path(forwardX, forwardY, waterDir, &homePortX, &homePortY, 1, stones, raft, islandMap);
-        if(result < bestPathLength && (result > 0 && is_reachable(agent.location, homePortX, homePortY)) || (result >= 0 && agent.currentlyRafting)) {
-          bestPathLength = result;
-          *bestTargetPortX = forwardX;
-          *bestTargetPortY = forwardY;
-          *bestHomePortX = homePortX;
-          *bestHomePortY = homePortY;
-        }  
-      }
-      if(seen[forwardY][forwardX] == 1 ||
-        is_impassable_island_time(Wmap[forwardY][forwardX])) continue;
-      else {
-        spaces[counter].x = forwardX;
-        spaces[counter].y = forwardY;
-        seen[forwardY][forwardX] = 1;
-        counter++;
-      }
-    }
+  bool raft) {
+
+  int island = island_at(ctx, startPos.x, startPos.y);
+  assert(island > 0);
+  Island *target = &ctx->islandsInfo[island - 1];
+  int stonesUsed = target->crossing;
+  if(stonesUsed == -1 || (stonesUsed == 0 && !ctx->agent.currentlyRafting)) {
+    return MAX_DIST;
   }
-  if(bestPathLength > 0) return bestPathLength;
-  else return 0;
+  if(!raft && (stones && stonesUsed > stones)) return MAX_DIST;
+  *bestTargetPortX = target->port.x;
+  *bestTargetPortY = target->port.y;
+  *bestHomePortX = target->homePort.x;
+  *bestHomePortY = target->homePort.y;
+  return stonesUsed;
 }
 
-//set up for A* search
-char search_setup(int targetX, int targetY, bool waterSearch) {
-  int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int costToReach[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
+//save the shortest crossing from the current island to every other island in islandsInfo
+//(the water spaces crossed, i.e. the stones it would take, and the port at each end), read from the crossing graph
+void plan_crossings(AgentContext *ctx, int numIslands) {
+  int i;
+  for(i = 0; i < numIslands; i++) ctx->islandsInfo[i].crossing = -1;
+  CrossingRow *row = agent_crossings(ctx);
+  for(i = 0; i < row->numEdges; i++) {
+    CrossingEdge *edge = &row->edges[i];
+    int number = ctx->islandSets.sets[edge->to].number;
+    if(number < 2) continue;
+    Island *target = &ctx->islandsInfo[number - 1];
+    target->crossing = edge->crossing;
+    target->port = edge->port;
+    target->homePort = edge->homePort;
+  }
+}
 
-  Stack s = newStack();
-  pushOnto(s, agent.location.x, agent.location.y, agent.direction, 0,
-    adjusted_manhattan_dist(targetX, targetY, agent.location.x,
-    agent.location.y, agent.direction));
-  costToReach[agent.location.y][agent.location.x] = -1;
+//The crossing graph: for each island (island set) the shortest water crossing to every island it can reach,
+//from one BFS through the water seeded with all of its ports (see build_crossing_row()).
+//A row is built the first time it is asked for and kept until the island map changes (islandSets.revision),
+//so every tier of choose_island(), and every turn until something new is seen, reads the same crossings.
+
+//the crossings out of the island the agent is on
+CrossingRow *agent_crossings(AgentContext *ctx) {
+  islands_sync(ctx);
+  int root = island_find(ctx, find_cell(ctx, ctx->agent.location.x, ctx->agent.location.y));
+  //rafting (or standing on a stone we just put down) the agent isn't on an island,
+  //so the crossings start from where it is and only last this turn
+  if(root == NO_CELL) {
+    build_crossing_row(ctx, &ctx->crossings.scratch, NO_SET, true);
+    return &ctx->crossings.scratch;
+  }
+  return crossing_row(ctx, ctx->world.islandSet[root], !ctx->agent.currentlyRafting);
+}
 
-  Astar_search(s, targetX, targetY, predecessor, costToReach,
-    waterSearch);
+//the crossings out of an island, built if the island map has changed since they were last.
+//walked only starts them from the ports the agent can walk to, so the row
+//is also rebuilt if the agent can't walk to where it was built from any more
+CrossingRow *crossing_row(AgentContext *ctx, int set, bool walked) {
+  crossing_rows_grow(ctx);
+  CrossingRow *row = &ctx->crossings.rows[set];
+  if(crossing_row_stale(ctx, row, walked)) {
+    build_crossing_row(ctx, row, set, walked);
+  } else {
+    ctx->crossings.reused++;
+  }
+  return row;
+}
 
-  disposeStack(s);
-  return map_path(predecessor, targetX, targetY);
+//has the island map changed (or the agent moved somewhere it can't walk from) since a row was built
+bool crossing_row_stale(AgentContext *ctx, CrossingRow *row, bool walked) {
+  return !row->built || row->revision != ctx->islandSets.revision ||
+    row->walked != walked ||
+    (walked && !is_reachable(ctx, ctx->agent.location, row->from.x, row->from.y));
 }
 
-//Uses A* search to a given square
-void Astar_search(Stack s, int targetX, int targetY,
-  int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP], 
-  int costToReach[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP],
-  bool waterSearch) {
+//make sure there is a row for every island set
+void crossing_rows_grow(AgentContext *ctx) {
+  if(ctx->crossings.numRows >= ctx->islandSets.numSets) return;
+  int numRows = ctx->crossings.numRows ? ctx->crossings.numRows : INITIAL_ISLANDS;
+  while(numRows < ctx->islandSets.numSets) numRows *= 2;
+  ctx->crossings.rows = realloc(ctx->crossings.rows, numRows * sizeof(CrossingRow));
+  assert(ctx->crossings.rows != NULL);
+  memset(ctx->crossings.rows + ctx->crossings.numRows, 0,
+    (numRows - ctx->crossings.numRows) * sizeof(CrossingRow));
+  ctx->crossings.numRows = numRows;
+}
 
-  int xPos, yPos, dir, distFromStart, heuristicCost;
-  popFrom(s, &xPos, &yPos, &dir, &distFromStart, &heuristicCost);
-  //pop the space from the stack with the lowest heuristic cost (distFromStart + adjusted_manhattam_dist())
-  costToReach[yPos][xPos] = distFromStart;
-  int newXPos, newYPos, newDir, newDistFromStart, newHeuristicCost;
+//build the rows out of every numbered island that is out of date, spread over the thread pool.
+//Each row is a separate search that only reads the map, so they can be built in any order
+void prefetch_crossings(AgentContext *ctx, int numIslands) {
+  crossing_rows_grow(ctx);
+  int numJobs = 0;
   int i;
-  //look at the 4 spaces adjacent to this one (only looking behind the bot on the first space as
-  //after that it will be the space we just came from)
-  for(i = 0; i < NUM_DIRECTIONS; i++) {
-    newDir = (dir + i) % 4; 
-    result_of_move(xPos, yPos, newDir, &newXPos, &newYPos);
-    switch(i) {
-      case UP:
-        newDistFromStart = distFromStart + 1;
-        break;
-      case RIGHT: case LEFT:
-        newDistFromStart = distFromStart + 2;
-        break;
-      case DOWN:
-        if(xPos == agent.location.x && yPos == agent.location.y) {
-          newDistFromStart = distFromStart + 3;
-        }
-        else continue;
-    }
-    //check that this space is passable (or is water if we are water searching)
-    bool impassable = true;
-    if(waterSearch == true) {
-      if(Wmap[newYPos][newXPos] == '~') impassable = false;
-    } else if((targetY == AGENT_START && targetX == AGENT_START) || 
-      (targetY == agent.seenGold.y && targetX == agent.seenGold.x)) {
-      impassable = is_impassable_island_time(Wmap[newYPos][newXPos]);
-    } else impassable = is_impassable(Wmap[newYPos][newXPos]);
-
-    //if the current space is passable and this is the shortest path we have found to it so far
-    //(tracked using CostToReach) then save its cost and the predecessor to it (so we can backtrack through the
-    //route taken once we find the target)
-    if(impassable != true ||
-      (newXPos == targetX && newYPos == targetY)) {
-      if(costToReach[newYPos][newXPos] == 0 ||
-        costToReach[newYPos][newXPos] > newDistFromStart) {
-
-        costToReach[newYPos][newXPos] = newDistFromStart;
-        predecessor[newXPos + DOUBLE_MAX_MAP * newYPos] =
-          xPos + DOUBLE_MAX_MAP * yPos;
-        //If the space is the target then we can stop searching.
-        if(newXPos == targetX && newYPos == targetY) {
-          return;
-        }
-        //if not the target, add it to the stack so we can search from it in future iterations.
-        newHeuristicCost = newDistFromStart +
-        adjusted_manhattan_dist(targetX, targetY, newXPos, newYPos, newDir);
-        pushOnto(s, newXPos, newYPos, newDir,
-          newDistFromStart, newHeuristicCost);
-      }
+  for(i = 2; i <= numIslands; i++) {
+    int set = ctx->hops.sets[i];
+    if(set != NO_SET && crossing_row_stale(ctx, &ctx->crossings.rows[set], false)) {
+      ctx->hops.jobs[numJobs++] = set;
     }
   }
-  return Astar_search(s, targetX, targetY, predecessor,
-    costToReach, waterSearch);
+  if(numJobs < PARALLEL_MIN_JOBS) return;
+  //the island sets' paths are compressed as they are followed, so do it now rather than in the threads
+  int cell;
+  for(cell = 0; cell < ctx->world.numTiles * TILE_CELLS; cell++) island_find(ctx, cell);
+  ctx->crossings.builds += numJobs;
+  pool_run(ctx, numJobs, prefetch_job);
 }
 
-//given a list of predecessors map the path to find the next action needed to travel that path.
-//We do this by backtracking through the predecessor list.
-char map_path(int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP],
-  int currX, int currY) {
-  int predX =
-    predecessor[currX + DOUBLE_MAX_MAP * currY] % DOUBLE_MAX_MAP;
-  int predY =
-    predecessor[currX + DOUBLE_MAX_MAP * currY] / DOUBLE_MAX_MAP;
+//one job of prefetch_crossings()
+void prefetch_job(AgentContext *ctx, int job, Workspace *ws) {
+  int set = ctx->hops.jobs[job];
+  crossing_bfs(ctx, ws, &ctx->crossings.rows[set], set, false);
+}
 
-  if(predX == agent.location.x && predY == agent.location.y) {
-    int i;
-    for(i = 0; i < NUM_DIRECTIONS; i++) {
-      int dir = (agent.direction + i) % 4;
-      int resultX, resultY;
-      result_of_move(predX, predY, dir, &resultX, &resultY);
-      if(resultX == currX && resultY == currY) break;
-    }
+//find the shortest water crossing from an island (or the agent if set is NO_SET) to every island it can reach.
+//A BFS through the water seeded with every port on the island (only those the agent can walk to if walked),
+//so each island is first reached by its shortest crossing. Ties go to the port closest to the agent and then
+//the island port closest to the first space we saw of that island
+void build_crossing_row(AgentContext *ctx, CrossingRow *row, int set, bool walked) {
+  ctx->crossings.builds++;
+  Workspace *ws = acquire_workspace(ctx);
+  crossing_bfs(ctx, ws, row, set, walked);
+  release_workspace(ctx, ws);
+}
 
-    switch(i) {
-      case UP:
-        return 'f';
-        break;
-      case RIGHT: case DOWN: 
-        return 'r';
-        break;
-      case LEFT:
-        return 'l';
+//the search for build_crossing_row() in a workspace. Unless walked (which uses the survey) it only reads
+//the map, so the thread pool can run it
+void crossing_bfs(AgentContext *ctx, Workspace *ws, CrossingRow *row, int set, bool walked) {
+  row->built = true;
+  row->revision = ctx->islandSets.revision;
+  row->walked = walked;
+  row->from = ctx->agent.location;
+  row->numEdges = 0;
+  int counter = 0;
+  int cell, i;
+  for(cell = 0; cell < ctx->world.numTiles * TILE_CELLS; cell++) {
+    int x = cell_x(ctx, cell);
+    int y = cell_y(ctx, cell);
+    if(set == NO_SET) {
+      if(x != ctx->agent.location.x || y != ctx->agent.location.y) continue;
+    } else {
+      int root = island_root(ctx, cell);
+      if(root == NO_CELL || ctx->world.islandSet[root] != set) continue;
+    }
+    if(adjacent_to(ctx, y, x, '~') == -1) continue;
+    if(walked && !is_reachable(ctx, ctx->agent.location, x, y)) continue;
+    ws->spaces[counter].x = x;
+    ws->spaces[counter].y = y;
+    ws->from[cell] = cell;
+    mark_visited(ctx, ws, x, y);
+    counter++;
+  }
+  if(walked) {
+    for(i = 0; i < counter; i++) {
+      ws->ports[i].port = ws->spaces[i];
+      ws->ports[i].cost = field_cost(ctx, ws->spaces[i].x, ws->spaces[i].y);
+      ws->ports[i].found = i;
+    }
+    qsort(ws->ports, counter, sizeof(PortCost), closer_port);
+    for(i = 0; i < counter; i++) ws->spaces[i] = ws->ports[i].port;
+  }
+  //every space in a layer has crossed the same number of water spaces
+  int crossed = 0;
+  int layerEnd = counter;
+  for(i = 0; i < counter; i++) {
+    if(i == layerEnd) {
+      crossed++;
+      layerEnd = counter;
+    }
+    int from = ws->from[find_cell(ctx, ws->spaces[i].x, ws->spaces[i].y)];
+    int dir;
+    for(dir = 0; dir < 4; dir++) {
+      int forwardX, forwardY;
+      result_of_move(ws->spaces[i].x, ws->spaces[i].y, dir,
+        &forwardX, &forwardY);
+      //we can't chop a tree down from a raft, so we can't land on one
+      int root = island_root(ctx, find_cell(ctx, forwardX, forwardY));
+      if(root != NO_CELL && ctx->world.islandSet[root] != set &&
+        wmap_at(ctx, forwardX, forwardY) != 'T') {
+        Coords port = {forwardX, forwardY};
+        int reach = crossed > 0 ? bridge_reach(ctx, ws->spaces[i].x, ws->spaces[i].y,
+          set, ctx->world.islandSet[root]) : 0;
+        crossing_edge(ctx, row, ctx->world.islandSet[root], crossed, reach, port, from);
+      }
+      if(wmap_at(ctx, forwardX, forwardY) != '~' ||
+        was_visited(ctx, ws, forwardX, forwardY)) continue;
+      ws->spaces[counter].x = forwardX;
+      ws->spaces[counter].y = forwardY;
+      ws->from[find_cell(ctx, forwardX, forwardY)] = from;
+      mark_visited(ctx, ws, forwardX, forwardY);
+      counter++;
     }
   }
-
-  return map_path(predecessor, predX, predY);
 }
 
-//search for a certain island number using BFS.
-//We cannot use A* as we do not know which individual square we are mapping to.
-//But this still guarantees an optimal length route
-//stack is prioritised based on distance from the start rather than a heuristic
-bool BFS_water_search(Stack s,
-  int costToReach[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP],
-  int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP],
-  int *foundPortX, int *foundPortY, int targetIsland,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]) {
+//the BFS reached an island at a port, crossing the given water spaces from a home port.
+//Keep it if it is the first crossing to that island or ties with it and either leaves a stone in reach of more
+//islands or lands closer to the first space we saw of it
+void crossing_edge(AgentContext *ctx, CrossingRow *row, int to, int crossed, int reach, Coords port,
+  int homeCell) {
+  int i;
+  for(i = 0; i < row->numEdges && row->edges[i].to != to; i++);
+  CrossingEdge *edge = &row->edges[i];
+  if(i < row->numEdges) {
+    int number = ctx->islandSets.sets[to].number;
+    if(edge->crossing != crossed || number == 0 || reach < edge->reach) return;
+    Coords first = ctx->islandsInfo[number - 1].firstSpaceSeen;
+    if(reach == edge->reach && abs(port.x - first.x) + abs(port.y - first.y) >=
+      abs(edge->port.x - first.x) + abs(edge->port.y - first.y)) return;
+  } else {
+    if(row->numEdges == row->capacity) {
+      row->capacity = row->capacity ? row->capacity * 2 : INITIAL_ISLANDS;
+      row->edges = realloc(row->edges, row->capacity * sizeof(CrossingEdge));
+      assert(row->edges != NULL);
+    }
+    edge = &row->edges[row->numEdges++];
+    edge->to = to;
+  }
+  edge->crossing = crossed;
+  edge->reach = reach;
+  edge->port = port;
+  edge->homePort.x = cell_x(ctx, homeCell);
+  edge->homePort.y = cell_y(ctx, homeCell);
+}
 
-  int xPos, yPos, dir, distFromStart, heuristicCost;
-  //if e run out of spaces to check then we have not found a path
-  if(s->top == NULL) return 0;
-  popFrom(s, &xPos, &yPos, &dir, &distFromStart, &heuristicCost);
+//the islands (other than the ones a crossing leaves and lands on) next to a stone put down in the water at x, y
+//or next to the water beside it. A stone left there brings them closer for the hops after this one
+int bridge_reach(AgentContext *ctx, int x, int y, int set, int to) {
+  int seen[NUM_DIRECTIONS * (NUM_DIRECTIONS + 1)];
+  int numSeen = 0;
+  int dir;
+  for(dir = 0; dir < NUM_DIRECTIONS * (NUM_DIRECTIONS + 1); dir++) {
+    //the first four look around the stone, the rest around each space beside it
+    int nearX = x, nearY = y;
+    if(dir >= NUM_DIRECTIONS) {
+      result_of_move(x, y, dir / NUM_DIRECTIONS - 1, &nearX, &nearY);
+      if(wmap_at(ctx, nearX, nearY) != '~') continue;
+    }
+    int spaceX, spaceY;
+    result_of_move(nearX, nearY, dir % NUM_DIRECTIONS, &spaceX, &spaceY);
+    int root = island_root(ctx, find_cell(ctx, spaceX, spaceY));
+    if(root == NO_CELL) continue;
+    int island = ctx->world.islandSet[root];
+    if(island == set || island == to) continue;
+    int i;
+    for(i = 0; i < numSeen && seen[i] != island; i++);
+    if(i == numSeen) seen[numSeen++] = island;
+  }
+  return numSeen;
+}
 
-  costToReach[yPos][xPos] = distFromStart;
-  int newXPos, newYPos, newDir, newDistFromStart, newHeuristicCost;
+//The hop planner. Once the gold has been seen the island hops can be planned as a whole instead of one at a time:
+//a search over (island, stones, raft, axe, key, gold) states, moving between islands along the crossing graph,
+//for the cheapest trip that picks up the gold and gets back to the island we started on.
+//Arriving on an island for the first time collects what is on it (visited remembers which islands are spent).
+//Labels are settled cheapest first and a label is dropped if one already settled on the same island has at least
+//its stones and tools with no more islands spent, so each inventory is only expanded once per island.
+
+//plan the cheapest trip for the gold and home. If there is one, save its first hop as the IslandCrossing.
+//Returns whether it found one
+bool plan_hops(AgentContext *ctx, int numIslands, IslandCrossing *ic) {
+  if(numIslands > MAX_HOP_ISLANDS || (ctx->agent.seenGold.x == -1 && !ctx->agent.gold)) {
+    return false;
+  }
+  hop_sets(ctx, numIslands);
+  prefetch_crossings(ctx, numIslands);
+  ctx->hops.runs++;
+  ctx->hops.numLabels = 0;
   int i;
-  //search radially outwards from the current position
-  for(i = 0; i < NUM_DIRECTIONS; i++) {
-    newDir = (dir + i) % 4; 
-    result_of_move(xPos, yPos, newDir, &newXPos, &newYPos);
-    switch(i) {
-      case UP: case RIGHT: case LEFT:
-        newDistFromStart = distFromStart + 1;
-        break;
-      case DOWN:
-        if(xPos == agent.location.x && yPos == agent.location.y) {
-          newDistFromStart = distFromStart + 1;
-        }
-        else continue;
-    }
-    //as we are only using water we only store water spaces as possible path nodes
-    if(Wmap[newYPos][newXPos] == '~' ||
-      islandMap[newYPos][newXPos] == targetIsland) {
-      if(costToReach[newYPos][newXPos] == 0 ||
-        costToReach[newYPos][newXPos] > newDistFromStart) {
-
-        costToReach[newYPos][newXPos] = newDistFromStart;
-        predecessor[newXPos + DOUBLE_MAX_MAP * newYPos] =
-          xPos + DOUBLE_MAX_MAP * yPos;
-      //if the given space is on the island we want to find, then we hve found an optimal path
-        if(islandMap[newYPos][newXPos] == targetIsland)  {
-          *foundPortX = newXPos;
-          *foundPortY = newYPos;
-          return 1;
-        }
-        //else, push this new space onto the stack
-        newHeuristicCost = newDistFromStart;
-        pushOnto(s, newXPos, newYPos, newDir,
-          newDistFromStart, newHeuristicCost);
+  for(i = 0; i <= numIslands; i++) ctx->hops.head[i] = NO_NODE;
+
+  HopLabel start = {0};
+  start.island = 1;
+  start.stones = ctx->agent.stones;
+  start.raft = ctx->agent.raft;
+  start.axe = ctx->agent.axe;
+  start.key = ctx->agent.key;
+  start.gold = ctx->agent.gold;
+  start.at = ctx->agent.location;
+  start.parent = NO_NODE;
+  hop_arrive(ctx, &start);
+
+  Queue q = newQueue(ctx);
+  //the queue's x is the label, its priority the cost
+  pushOnto(q, hop_add(ctx, &start), 0, 0, 0, 0);
+  int goal = NO_NODE;
+  while(!queueEmpty(q) && ctx->hops.numLabels < MAX_HOP_LABELS && !deadline_passed(ctx)) {
+    int index, unused, cost;
+    popFrom(q, &index, &unused, &unused, &unused, &cost);
+    HopLabel label = ctx->hops.labels[index];
+    if(hop_dominated(ctx, &label)) continue;
+    hop_settle(ctx, index);
+    if(label.gold && ctx->islandsInfo[label.island - 1].returnSquare) {
+      goal = index;
+      break;
+    }
+    ctx->hops.expansions++;
+    CrossingRow *row = label.island == 1 ? agent_crossings(ctx) :
+      crossing_row(ctx, ctx->hops.sets[label.island], false);
+    for(i = 0; i < row->numEdges; i++) {
+      CrossingEdge *edge = &row->edges[i];
+      int to = ctx->islandSets.sets[edge->to].number;
+      if(to < 1 || to == label.island) continue;
+      HopLabel next = label;
+      //stones are put down before a raft is used, a raft is only needed for the rest of the way
+      if(label.stones >= edge->crossing) {
+        next.stones -= edge->crossing;
+        next.byRaft = false;
+      } else if(label.raft) {
+        next.stones = 0;
+        next.raft = false;
+        next.byRaft = true;
+      } else {
+        continue;
       }
+      next.island = to;
+      next.cost = label.cost + edge->crossing + 1 +
+        abs(edge->homePort.x - label.at.x) + abs(edge->homePort.y - label.at.y);
+      next.crossing = edge->crossing;
+      next.homePort = edge->homePort;
+      next.port = edge->port;
+      next.at = edge->port;
+      next.parent = index;
+      hop_arrive(ctx, &next);
+      if(next.cost < NUM_BUCKETS) pushOnto(q, hop_add(ctx, &next), 0, 0, 0, next.cost);
     }
-
   }
-
-  return BFS_water_search(s, costToReach, predecessor, foundPortX, 
-    foundPortY, targetIsland, islandMap);
+  disposeQueue(ctx, q);
+  //nothing to plan if we are already home with the gold
+  if(goal == NO_NODE || ctx->hops.labels[goal].parent == NO_NODE) return false;
+
+  int first = goal;
+  while(ctx->hops.labels[first].parent != 0) first = ctx->hops.labels[first].parent;
+  HopLabel *hop = &ctx->hops.labels[first];
+  ic->islandNum = hop->island;
+  ic->homePort = hop->homePort;
+  ic->islandPort = hop->port;
+  ic->raftNeeded = hop->byRaft;
+  ic->stonesNeeded = hop->byRaft ? 0 : hop->crossing;
+  ctx->hops.plans++;
+  return true;
 }
 
-//setup for BFS_water_search()
-//equivalent to search_setup() for the A* search
-int plan_water_path(int islandPortX, int islandPortY, int dir,
-  int *foundPortX, int *foundPortY, int targetIsland, 
-  int stones, bool raft, int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]) {
-
-  int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int costToReach[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  Stack s = newStack();
-  //push the island port onto the stack as our starting port for the search for the agent's current island
-  pushOnto(s, islandPortX, islandPortY, dir, 0, 0);
-  costToReach[islandPortY][islandPortX] = -1;
-  int result = BFS_water_search(s, costToReach, predecessor, foundPortX,
-    foundPortY, targetIsland, islandMap);
-  disposeStack(s);
-  if(result) {
-    //if we found a route and to the island, make sure we have the resources to get there
-    int stonesUsed = 0;
-    count_stones(predecessor, *foundPortX, *foundPortY, islandPortX,
-      islandPortY, &stonesUsed);
-    if(!raft && (stones && stonesUsed > stones)) return -1;
-    else return stonesUsed;
+//the island set of each island number, so the crossing graph can be asked about it
+void hop_sets(AgentContext *ctx, int numIslands) {
+  if(numIslands + 1 > ctx->hops.capacity) {
+    ctx->hops.capacity = (numIslands + 1) * 2;
+    ctx->hops.sets = realloc(ctx->hops.sets, ctx->hops.capacity * sizeof(int));
+    ctx->hops.head = realloc(ctx->hops.head, ctx->hops.capacity * sizeof(int));
+    ctx->hops.jobs = realloc(ctx->hops.jobs, ctx->hops.capacity * sizeof(int));
+    assert(ctx->hops.sets != NULL && ctx->hops.head != NULL && ctx->hops.jobs != NULL);
+  }
+  int i;
+  for(i = 0; i <= numIslands; i++) ctx->hops.sets[i] = NO_SET;
+  for(i = 0; i < ctx->islandSets.numSets; i++) {
+    IslandSet *set = &ctx->islandSets.sets[i];
+    if(set->live && set->number > 0) ctx->hops.sets[set->number] = i;
   }
-  return -1;
 }
 
-//count the number of stones used to traverse a path
-//by counting the number of water spaces traversed
-void count_stones(int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP],
-  int currX, int currY, int startingX, int startingY, int *stones) {
+//arriving on an island for the first time picks up what is on it, and a tree (with an axe) is a raft
+void hop_arrive(AgentContext *ctx, HopLabel *label) {
+  Island *info = &ctx->islandsInfo[label->island - 1];
+  unsigned long long bit = 1ULL << (label->island - 1);
+  if(!(label->visited & bit)) {
+    label->visited |= bit;
+    label->stones += info->stones;
+    label->axe = label->axe || info->axe;
+    label->key = label->key || info->key;
+    label->gold = label->gold || info->gold;
+  }
+  label->raft = label->raft || (info->tree && label->axe);
+}
 
-  int predX =
-    predecessor[currX + DOUBLE_MAX_MAP * currY] % DOUBLE_MAX_MAP;
-  int predY =
-    predecessor[currX + DOUBLE_MAX_MAP * currY] / DOUBLE_MAX_MAP;
+//keep a label for the search. Returns its index
+int hop_add(AgentContext *ctx, HopLabel *label) {
+  if(ctx->hops.numLabels == ctx->hops.labelCapacity) {
+    ctx->hops.labelCapacity = ctx->hops.labelCapacity ? ctx->hops.labelCapacity * 2 : INITIAL_POOL_SIZE;
+    ctx->hops.labels = realloc(ctx->hops.labels, ctx->hops.labelCapacity * sizeof(HopLabel));
+    assert(ctx->hops.labels != NULL);
+  }
+  ctx->hops.labels[ctx->hops.numLabels] = *label;
+  ctx->hops.labels[ctx->hops.numLabels].nextAt = NO_NODE;
+  return ctx->hops.numLabels++;
+}
 
-  if(predX == startingX && predY == startingY) return;
-  (*stones)++;
-  return count_stones(predecessor, predX, predY, startingX,
-    startingY, stones);
+//add a label to the ones settled on its island
+void hop_settle(AgentContext *ctx, int index) {
+  HopLabel *label = &ctx->hops.labels[index];
+  label->nextAt = ctx->hops.head[label->island];
+  ctx->hops.head[label->island] = index;
 }
 
-//create new node
-static Link newNode(int xPos, int yPos, int dir,
-  int distFromStart, int heuristicCost) {
+//has a label settled on the same island (so no more expensive) got at least as much to work with
+bool hop_dominated(AgentContext *ctx, HopLabel *label) {
+  int other;
+  for(other = ctx->hops.head[label->island]; other != NO_NODE;
+    other = ctx->hops.labels[other].nextAt) {
+    HopLabel *settled = &ctx->hops.labels[other];
+    if(settled->stones >= label->stones && settled->raft >= label->raft &&
+      settled->axe >= label->axe && settled->key >= label->key &&
+      settled->gold >= label->gold &&
+      (settled->visited & ~label->visited) == 0) return true;
+  }
+  return false;
+}
 
-  Link new = malloc(sizeof(searchNode));
-  assert(new != NULL);
-  new->xPos = xPos;
-  new->yPos = yPos;
-  new->dir = dir; 
-  new->distFromStart = distFromStart;
-  new->heuristicCost = heuristicCost;
-  new->next = NULL;
-  return new;
+//qsort() order for ports, the cheapest to walk to from the agent first
+int closer_port(const void *a, const void *b) {
+  const PortCost *portA = a;
+  const PortCost *portB = b;
+  if(portA->cost != portB->cost) return portA->cost - portB->cost;
+  return portA->found - portB->found;
 }
 
-//create stack
-Stack newStack() {
-  Stack new = malloc(sizeof(StackRep));
-  assert(new != NULL);
-  new->top = NULL;
-  return new;
+//plan a route to a target with the D* Lite planner
+//if the plan made on an earlier turn still leads to this target, replay it instead of searching again
+char search_setup(AgentContext *ctx, int targetX, int targetY, bool waterSearch) {
+  char action = replay_plan(ctx, targetX, targetY, waterSearch);
+  if(action != 0) return action;
+
+  ctx->plan.misses++;
+  //by land the survey has usually already found the way there this turn,
+  //by water the crossing has to suit the stones we have
+  if(!waterSearch) action = field_route(ctx, targetX, targetY);
+  else action = cross_water(ctx, targetX, targetY);
+  if(action == 0) {
+    SearchSpec spec;
+    target_spec(ctx, &spec, targetX, targetY, waterSearch);
+    int start = STATE(ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction);
+    if(dstar_plan(ctx, &ctx->routePlanner, &spec, start) >= DSTAR_INF) {
+      ctx->plan.valid = false;
+      return 0;
+    }
+    action = dstar_map_path(ctx, &ctx->routePlanner, start);
+    if(action == 0) return 0;
+  }
+  ctx->plan.targetX = targetX;
+  ctx->plan.targetY = targetY;
+  ctx->plan.waterSearch = waterSearch;
+  ctx->plan.next = 1;
+  return action;
 }
 
-//free stack
-void disposeStack(Stack s) {
-  if (s == NULL) return;
-  Link next, curr = s->top;
-  while (curr != NULL) {
-    next = curr->next;
-    disposeNode(curr);  
-    curr = next;
+//returns the next action of the cached plan, or 0 if it can not be used for this target.
+//The plan is used as long as the decision cascade is still after the same target for the same reason,
+//passability has not changed (no new tools) and we are where the plan expects us to be.
+//Spaces changing along the rest of the path are caught in update_Wmap() via plan_space_changed().
+char replay_plan(AgentContext *ctx, int targetX, int targetY, bool waterSearch) {
+  if(!ctx->plan.valid || ctx->plan.next >= ctx->plan.length) return 0;
+  int state = STATE(ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction);
+  if(ctx->plan.tier == ctx->goalTier && ctx->plan.targetX == targetX &&
+    ctx->plan.targetY == targetY && ctx->plan.waterSearch == waterSearch &&
+    ctx->plan.key == ctx->agent.key && ctx->plan.axe == ctx->agent.axe &&
+    ctx->plan.states[ctx->plan.next] == state) {
+
+    ctx->plan.hits++;
+    return ctx->plan.actions[ctx->plan.next++];
   }
+  ctx->plan.valid = false;
+  return 0;
 }
 
-//pop the item from the top of the priority stack
-void popFrom(Stack s, int *xPos, int *yPos, int *dir,
-  int *distFromStart, int *heuristicCost) {
+//called when a space on the world map changes. If it is on the part of the plan
+//still ahead of us then the plan was made with out of date information.
+void plan_space_changed(AgentContext *ctx, int x, int y) {
+  int cell = find_cell(ctx, x, y);
+  if(ctx->plan.valid && cell != NO_CELL && ctx->plan.pathId[cell] == ctx->plan.id &&
+    ctx->plan.pathIndex[cell] > ctx->plan.next) {
+    ctx->plan.valid = false;
+  }
+}
 
-  assert (s != NULL && s->top != NULL);
-    *xPos = s->top->xPos;
-    *yPos = s->top->yPos;
-    *dir = s->top->dir;
-    *distFromStart = s->top->distFromStart;
-    *heuristicCost = s->top->heuristicCost;
-  Link old = s->top;
-  s->top = old->next;
-  free(old);
-  return;
+//prints how often the cached plan saved us a search
+void print_plan_stats(AgentContext *ctx, FILE *out) {
+  long total = ctx->plan.hits + ctx->plan.misses;
+  fprintf(out, "plan cache: %ld hits, %ld misses (%.1f%% hit rate)\n",
+    ctx->plan.hits, ctx->plan.misses, total ? 100.0 * ctx->plan.hits / total : 0.0);
+  fprintf(out, "route planner: %ld expansions, %ld new searches\n",
+    ctx->routePlanner.expansions, ctx->routePlanner.resets);
+  fprintf(out, "survey: %ld queries answered by %ld searches (%ld expansions), %ld routes read from the field\n",
+    ctx->survey.queries, ctx->survey.runs, ctx->survey.expansions, ctx->survey.routes);
+  fprintf(out, "water crossings: %ld searches, %ld labels settled\n",
+    ctx->pareto.runs, ctx->pareto.labels);
 }
 
-//push a new node onto the priority stack. Prioritised in order of manhattan distance from the target
-void pushOnto(Stack s, int xPos, int yPos, int dir,
-  int distFromStart, int heuristicCost) {
-  //create a new node
-  Link new = newNode(xPos, yPos, dir, distFromStart, heuristicCost);
-  Link curr = s->top;
-  //place the node in its appropriate place in the queue (prioritised by heuristic cost)
-  if(curr == NULL) {
-    s->top = new;
-    return;
-  } else if(curr->next == NULL) {
-    if(heuristicCost < s->top->heuristicCost) {
-      new->next = s->top;
-      s->top = new;
-    } else s->top->next = new;
-    return;
-  }
-  while(curr->next != NULL &&
-    curr->next->heuristicCost < heuristicCost) {
+//the searches started so far of every kind: route plans from scratch, surveys, water crossings, hop plans,
+//and flood fills and crossing graph rows (one per workspace handed out or job run on the thread pool)
+long search_count(AgentContext *ctx) {
+  return ctx->routePlanner.resets + ctx->survey.runs + ctx->pareto.runs + ctx->hops.runs +
+    ctx->workspaceStats.acquired + ctx->pool.jobs;
+}
 
-    curr = curr->next;
-  }
-  new->next = curr->next;
-  curr->next = new;
+//fill in the search description for a path to a single target space
+void target_spec(AgentContext *ctx, SearchSpec *spec, int targetX, int targetY,
+  bool waterSearch) {
 
-  return;
+  spec->waterSearch = waterSearch;
+  spec->targetX = targetX;
+  spec->targetY = targetY;
+  //home and the gold are worth walking through stones (and trees if we have an axe) for
+  spec->islandTime = (targetY == AGENT_START && targetX == AGENT_START) ||
+    (targetY == ctx->agent.seenGold.y && targetX == ctx->agent.seenGold.x);
 }
-//free node
-static void disposeNode(Link curr) {
-  assert(curr != NULL);
-  free(curr);
+
+//have we reached what we are searching for
+bool is_search_goal(SearchSpec *spec, int x, int y) {
+  return x == spec->targetX && y == spec->targetY;
 }
 
-//check if a space is reachable from the agent's current location by land
-int is_reachable(Coords agentLocation, int targetX, int targetY) {
-  if(agent.location.x == targetX && agent.location.y == targetY) return 1;
-  Coords spaces[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int seen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  spaces[0].x = agentLocation.x;
-  spaces[0].y = agentLocation.y;
+//check that this space can be stepped into (is passable, or is water if we are water searching).
+//The target can always be entered
+bool lattice_enterable(AgentContext *ctx, SearchSpec *spec, int x, int y) {
+  if(is_search_goal(spec, x, y)) return true;
+  if(spec->waterSearch) return wmap_at(ctx, x, y) == '~';
+  if(spec->islandTime) return !is_impassable_island_time(ctx, wmap_at(ctx, x, y));
+  return !is_impassable(ctx, wmap_at(ctx, x, y));
+}
 
-  int counter = 1;
-  int i, j;
+//make room for the states and spaces of newly allocated tiles
+void plan_grow(AgentContext *ctx, int oldCells, int newCells) {
+  int from = oldCells * NUM_DIRECTIONS;
+  int to = newCells * NUM_DIRECTIONS;
+  ctx->plan.actions = grow_array(ctx, ctx->plan.actions, sizeof(char), from, to);
+  ctx->plan.states = grow_array(ctx, ctx->plan.states, sizeof(int), from, to);
+  ctx->plan.path = grow_array(ctx, ctx->plan.path, sizeof(int), from, to);
+  ctx->plan.pathId = grow_array(ctx, ctx->plan.pathId, sizeof(int), oldCells, newCells);
+  ctx->plan.pathIndex = grow_array(ctx, ctx->plan.pathIndex, sizeof(int), oldCells,
+    newCells);
+  ctx->speculation.path = grow_array(ctx, ctx->speculation.path, sizeof(int), from, to);
+}
 
-  //check radially out from the current position
-  for(i = 0; i < counter; i++) {
-    for(j = 0; j < 4; j++) {
-      int dir = (agent.direction + j) % 4; 
-      int forwardX, forwardY;
-      result_of_move(spaces[i].x, spaces[i].y, dir,
-        &forwardX, &forwardY);
+//save a path (a list of length + 1 states, starting where the agent is now) as the current plan
+//along with the spaces it passes through. Returns the first action
+char store_plan(AgentContext *ctx, int path[], int length) {
+  ctx->plan.id++;
+  ctx->plan.valid = true;
+  ctx->plan.tier = ctx->goalTier;
+  ctx->plan.key = ctx->agent.key;
+  ctx->plan.axe = ctx->agent.axe;
+  ctx->plan.length = length;
+  ctx->plan.next = 0;
+  int i;
+  for(i = length; i >= 0; i--) {
+    int cell = STATE_CELL(path[i]);
+    ctx->plan.states[i] = path[i];
+    //the path is walked backwards so the first step we meet in a space is its last one
+    if(ctx->plan.pathId[cell] != ctx->plan.id) {
+      ctx->plan.pathId[cell] = ctx->plan.id;
+      ctx->plan.pathIndex[cell] = i;
+    }
+    if(i == length) continue;
+    if(STATE_DIR(path[i]) == STATE_DIR(path[i + 1])) ctx->plan.actions[i] = 'f';
+    else if((STATE_DIR(path[i]) + 1) % 4 == STATE_DIR(path[i + 1])) {
+      ctx->plan.actions[i] = 'r';
+    }
+    else ctx->plan.actions[i] = 'l';
+  }
+  return ctx->plan.actions[0];
+}
 
-      if(seen[forwardY][forwardX] == 1) continue;
-      //if we have pathed to the target using only passable spaces then the target is reachable
-      if(forwardY == targetY && forwardX == targetX) {
-        return 1;
-      } 
-      //if the space is passable and reachable by land, add it to queue search from
-      if(is_impassable(Wmap[forwardY][forwardX]) == 0) {
-        spaces[counter].x = forwardX;
-        spaces[counter].y = forwardY;
-        seen[forwardY][forwardX] = 1;
-        counter++;
+//A water crossing trades stones against actions: the fastest way across can cross more water than the
+//fewest stones would. crossing_front() finds every crossing to a target that isn't beaten on both
+//(the Pareto front) in one search over the state lattice. Labels (stones used, actions taken) are settled
+//in order of actions, so a label is only kept if it uses fewer stones than every label already settled
+//in its state, and only while it uses fewer stones than the cheapest crossing found so far.
+
+//find the Pareto front of crossings from the agent through the water to a target, using at most maxStones
+//stones. Saved in pareto.front with the fewest actions first (and so the most stones).
+//Returns how many crossings are on the front
+int crossing_front(AgentContext *ctx, int targetX, int targetY, int maxStones) {
+  ctx->pareto.epoch++;
+  //the stamps from 2^32 searches ago would look current again, so clear them once
+  if(ctx->pareto.epoch == 0) {
+    memset(ctx->pareto.stamp, 0, NUM_STATES * sizeof(*ctx->pareto.stamp));
+    ctx->pareto.epoch = 1;
+  }
+  ctx->pareto.runs++;
+  ctx->pareto.poolSize = 0;
+  ctx->pareto.frontSize = 0;
+  ctx->pareto.start = STATE(ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction);
+
+  Queue q = newQueue(ctx);
+  //the queue's distance is the stones used, its priority the actions
+  pushOnto(q, ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction, 0, 0);
+  //out of time, the crossings found so far are still a front of their own
+  while(!queueEmpty(q) && !deadline_passed(ctx)) {
+    int xPos, yPos, dir, stones, actions;
+    popFrom(q, &xPos, &yPos, &dir, &stones, &actions);
+    int curr = STATE(xPos, yPos, dir);
+    if(ctx->pareto.stamp[curr] == ctx->pareto.epoch &&
+      ctx->pareto.pool[ctx->pareto.head[curr]].stones <= stones) continue;
+    if(ctx->pareto.frontSize > 0 &&
+      stones >= ctx->pareto.front[ctx->pareto.frontSize - 1].stones) continue;
+    pareto_label(ctx, curr, stones, actions);
+    if(xPos == targetX && yPos == targetY) {
+      pareto_option(ctx, curr, stones, actions);
+      if(stones == 0) break;
+      continue;
+    }
+    int i;
+    for(i = 0; i < 3; i++) {
+      int newXPos = xPos;
+      int newYPos = yPos;
+      int newDir = dir;
+      int newStones = stones;
+      switch(i) {
+        case 0:
+          result_of_move(xPos, yPos, dir, &newXPos, &newYPos);
+          if(newXPos == targetX && newYPos == targetY) break;
+          if(wmap_at(ctx, newXPos, newYPos) != '~') continue;
+          newStones++;
+          break;
+        case 1:
+          newDir = (dir + 1) % 4;
+          break;
+        default:
+          newDir = (dir + 3) % 4;
       }
+      if(newStones > maxStones) continue;
+      pushOnto(q, newXPos, newYPos, newDir, newStones, actions + 1);
     }
   }
-  return 0;
+  disposeQueue(ctx, q);
+  return ctx->pareto.frontSize;
 }
 
-//find the closest reachable space of a given type by land
-bool closest_reachable(Coords agentLocation, int *x,
-  int *y, int type) {
-
-  Coords spaces[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP];
-  int seen[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP] = {{0}};
-  spaces[0].x = agentLocation.x;
-  spaces[0].y = agentLocation.y;
-  seen[spaces[0].y][spaces[0].x] = 1;
+//settle a label in a state, in front of the ones already there (so the head always uses the fewest stones)
+void pareto_label(AgentContext *ctx, int state, int stones, int actions) {
+  if(ctx->pareto.poolSize == ctx->pareto.poolCapacity) {
+    ctx->pareto.poolCapacity = ctx->pareto.poolCapacity ? ctx->pareto.poolCapacity * 2 : NUM_DIRECTIONS * TILE_CELLS;
+    ctx->pareto.pool = realloc(ctx->pareto.pool, ctx->pareto.poolCapacity * sizeof(ParetoLabel));
+    assert(ctx->pareto.pool != NULL);
+  }
+  ParetoLabel *label = &ctx->pareto.pool[ctx->pareto.poolSize];
+  label->stones = stones;
+  label->actions = actions;
+  label->next = ctx->pareto.stamp[state] == ctx->pareto.epoch ? ctx->pareto.head[state] : NO_NODE;
+  ctx->pareto.head[state] = ctx->pareto.poolSize++;
+  ctx->pareto.stamp[state] = ctx->pareto.epoch;
+  ctx->pareto.labels++;
+}
+
+//add a crossing to the end of the front
+void pareto_option(AgentContext *ctx, int goal, int stones, int actions) {
+  if(ctx->pareto.frontSize == ctx->pareto.frontCapacity) {
+    ctx->pareto.frontCapacity = ctx->pareto.frontCapacity ? ctx->pareto.frontCapacity * 2 : INITIAL_ISLANDS;
+    ctx->pareto.front = realloc(ctx->pareto.front, ctx->pareto.frontCapacity * sizeof(CrossingOption));
+    assert(ctx->pareto.front != NULL);
+  }
+  CrossingOption *option = &ctx->pareto.front[ctx->pareto.frontSize++];
+  option->goal = goal;
+  option->stones = stones;
+  option->actions = actions;
+}
+
+//was a label with exactly these stones and actions settled in a state
+bool pareto_settled(AgentContext *ctx, int state, int stones, int actions) {
+  if(state == NO_STATE || ctx->pareto.stamp[state] != ctx->pareto.epoch) return false;
+  int label;
+  for(label = ctx->pareto.head[state]; label != NO_NODE; label = ctx->pareto.pool[label].next) {
+    if(ctx->pareto.pool[label].stones == stones && ctx->pareto.pool[label].actions == actions) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//save a crossing from the front as the current plan. Every label one action before a settled label
+//is settled in one of the three states it could have come from, so the path is found by looking there.
+//Returns the first action
+char crossing_route(AgentContext *ctx, CrossingOption *option) {
+  int state = option->goal;
+  int stones = option->stones;
+  int i;
+  ctx->plan.path[option->actions] = state;
+  for(i = option->actions; i > 0; i--) {
+    int cell = STATE_CELL(state);
+    int dir = STATE_DIR(state);
+    int behindX, behindY;
+    result_of_move(cell_x(ctx, cell), cell_y(ctx, cell), (dir + 2) % 4, &behindX, &behindY);
+    int behind = find_cell(ctx, behindX, behindY);
+    //stepping into water costs a stone, except into the target
+    int forwardStones = stones;
+    if(i < option->actions && ctx->world.symbols[cell] == '~') forwardStones--;
+    if(behind != NO_CELL && pareto_settled(ctx, behind * NUM_DIRECTIONS + dir,
+      forwardStones, i - 1)) {
+      state = behind * NUM_DIRECTIONS + dir;
+      stones = forwardStones;
+    } else if(pareto_settled(ctx, cell * NUM_DIRECTIONS + (dir + 3) % 4, stones, i - 1)) {
+      state = cell * NUM_DIRECTIONS + (dir + 3) % 4;
+    } else {
+      state = cell * NUM_DIRECTIONS + (dir + 1) % 4;
+      assert(pareto_settled(ctx, state, stones, i - 1));
+    }
+    ctx->plan.path[i - 1] = state;
+  }
+  assert(state == ctx->pareto.start);
+  return store_plan(ctx, ctx->plan.path, option->actions);
+}
+
+//plan a crossing through the water to a target for what we are carrying.
+//Stones are scarce so if we have any (they are used before a raft) take the crossing using the fewest,
+//otherwise we are on or have a raft and only the actions matter.
+//Returns the first action, or 0 if we can't get there
+char cross_water(AgentContext *ctx, int targetX, int targetY) {
+  bool raft = ctx->agent.raft || ctx->agent.currentlyRafting;
+  int options = crossing_front(ctx, targetX, targetY, raft ? MAX_DIST : ctx->agent.stones);
+  if(options == 0) return 0;
+  return crossing_route(ctx, &ctx->pareto.front[ctx->agent.stones > 0 ? options - 1 : 0]);
+}
+
+//make room for the states of newly allocated tiles
+void pareto_grow(AgentContext *ctx, int oldCells, int newCells) {
+  ctx->pareto.stamp = grow_array(ctx, ctx->pareto.stamp, sizeof(unsigned int),
+    oldCells * NUM_DIRECTIONS, newCells * NUM_DIRECTIONS);
+  ctx->pareto.head = grow_array(ctx, ctx->pareto.head, sizeof(int),
+    oldCells * NUM_DIRECTIONS, newCells * NUM_DIRECTIONS);
+}
+
+//The survey answers the "where is the closest ..." questions the decision cascade asks from where the agent is
+//(unseen space, perimeter, items, things that could be blocking us) with a single search per turn.
+//It is a Dijkstra search over the same (x, y, direction) lattice as the planners, so closest means cheapest
+//to actually walk to, turns included. Every space stepped into from a passable space is checked against
+//every goal, and the search only carries on past the cost it has reached when a query needs it to.
+//What it has searched is kept as a distance field (the cost of stepping into each space and the move that
+//got to each state), so the way to anything it has reached is read back from it rather than searched for again.
+
+//start a new survey from the agent's state
+void survey_start(AgentContext *ctx) {
+  ctx->survey.epoch++;
+  if(ctx->survey.epoch == 0) {
+    memset(ctx->survey.stamp, 0, NUM_STATES * sizeof(*ctx->survey.stamp));
+    memset(ctx->survey.enterStamp, 0, NUM_CELLS * sizeof(*ctx->survey.enterStamp));
+    ctx->survey.epoch = 1;
+  }
+  queue_empty_buckets(&ctx->survey.queue);
+  queue_reset(&ctx->survey.queue);
+  int i;
+  for(i = 0; i < NUM_GOALS; i++) ctx->survey.best[i] = MAX_DIST;
+  ctx->survey.start = STATE(ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction);
+  ctx->survey.cost[ctx->survey.start] = 0;
+  ctx->survey.move[ctx->survey.start] = 0;
+  ctx->survey.stamp[ctx->survey.start] = ctx->survey.epoch;
+  ctx->survey.settled = 0;
+  ctx->survey.numEntered = 0;
+  ctx->survey.valid = true;
+  ctx->survey.runs++;
+  pushOnto(&ctx->survey.queue, ctx->agent.location.x, ctx->agent.location.y, ctx->agent.direction, 0, 0);
+}
+
+//expand the cheapest state left. Only passable spaces (and the agent's own) are searched on from,
+//the space ahead of each is checked against the goals whether or not it can be entered
+void survey_step(AgentContext *ctx) {
+  int xPos, yPos, dir, distFromStart, heuristicCost;
+  popFrom(&ctx->survey.queue, &xPos, &yPos, &dir, &distFromStart, &heuristicCost);
+  int curr = STATE(xPos, yPos, dir);
+  //a state can be pushed more than once, only the cheapest copy is expanded
+  if(distFromStart > ctx->survey.cost[curr]) return;
+  ctx->survey.settled = distFromStart;
+  ctx->survey.expansions++;
+  int i;
+  for(i = 0; i < 3; i++) {
+    int newXPos = xPos;
+    int newYPos = yPos;
+    int newDir = dir;
+    switch(i) {
+      case 0:
+        result_of_move(xPos, yPos, dir, &newXPos, &newYPos);
+        survey_goals(ctx, newXPos, newYPos, distFromStart + 1, curr);
+        if(is_impassable(ctx, wmap_at(ctx, newXPos, newYPos))) continue;
+        break;
+      case 1:
+        newDir = (dir + 1) % 4;
+        break;
+      default:
+        newDir = (dir + 3) % 4;
+    }
+    int next = STATE(newXPos, newYPos, newDir);
+    if(ctx->survey.stamp[next] != ctx->survey.epoch || ctx->survey.cost[next] > distFromStart + 1) {
+      ctx->survey.cost[next] = distFromStart + 1;
+      ctx->survey.move[next] = i == 0 ? 'f' : (i == 1 ? 'r' : 'l');
+      ctx->survey.stamp[next] = ctx->survey.epoch;
+      pushOnto(&ctx->survey.queue, newXPos, newYPos, newDir, distFromStart + 1,
+        distFromStart + 1);
+    }
+  }
+}
+
+//a space can be stepped into from a state at the given cost, save it in the field
+//and for every goal it is the cheapest of so far
+void survey_goals(AgentContext *ctx, int x, int y, int cost, int from) {
+  if(x == ctx->agent.location.x && y == ctx->agent.location.y) return;
+  int cell = find_cell(ctx, x, y);
+  if(cell != NO_CELL && (ctx->survey.enterStamp[cell] != ctx->survey.epoch ||
+    ctx->survey.enterCost[cell] > cost)) {
+    if(ctx->survey.enterStamp[cell] != ctx->survey.epoch) ctx->survey.entered[ctx->survey.numEntered++] = cell;
+    ctx->survey.enterStamp[cell] = ctx->survey.epoch;
+    ctx->survey.enterCost[cell] = cost;
+    ctx->survey.enterFrom[cell] = from;
+  }
+  int goal;
+  for(goal = 0; goal < NUM_GOALS; goal++) {
+    if(cost < ctx->survey.best[goal] && survey_matches(ctx, goal, x, y)) {
+      ctx->survey.best[goal] = cost;
+      ctx->survey.hit[goal].x = x;
+      ctx->survey.hit[goal].y = y;
+      ctx->survey.from[goal] = from;
+    }
+  }
+}
+
+//is the space one the goal is looking for
+bool survey_matches(AgentContext *ctx, int goal, int x, int y) {
+  char space = wmap_at(ctx, x, y);
+  char blocker = 0;
+  switch(goal) {
+    case GOAL_UNSEEN:
+      return space == 0;
+    //a passable space on the edge of the island we haven't stood on
+    case GOAL_PERIMETER:
+      return !is_impassable(ctx, space) && been_at(ctx, x, y) == 0 &&
+        adjacent_to_impassable(ctx, y, x) != -1;
+    case GOAL_TREE:
+      return space == 'T';
+    case GOAL_STONE:
+      return space == 'o';
+    case GOAL_WATER:
+      return space == '~';
+    case GOAL_HOME:
+      return x == AGENT_START && y == AGENT_START;
+    case GOAL_GOLD:
+      return x == ctx->agent.seenGold.x && y == ctx->agent.seenGold.y;
+    case GOAL_KEY:
+      return x == ctx->agent.seenKey.x && y == ctx->agent.seenKey.y;
+    case GOAL_AXE:
+      return x == ctx->agent.seenAxe.x && y == ctx->agent.seenAxe.y;
+    case GOAL_BLOCKING_TREE:
+      blocker = 'T';
+      break;
+    case GOAL_BLOCKING_STONE:
+      blocker = 'o';
+      break;
+    default:
+      blocker = '~';
+  }
+  //a blocker with water (for water) or a space passable at island time next to it,
+  //that is itself next to unseen space
+  if(space != blocker) return false;
+  int blockerDir;
+  for(blockerDir = 0; blockerDir < 4; blockerDir++) {
+    int blockerX, blockerY;
+    result_of_move(x, y, blockerDir, &blockerX, &blockerY);
+    char beyond = wmap_at(ctx, blockerX, blockerY);
+    if((blocker == '~' ? beyond == '~' : !is_impassable_island_time(ctx, beyond)) &&
+      adjacent_to(ctx, blockerY, blockerX, 0) != -1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//the cheapest space for the goal from where the agent is this turn. Returns what it costs to step into it
+//(turns included) or -1 if there is none reachable. Once nothing left in the queue could be cheaper the answer is final
+int survey_nearest(AgentContext *ctx, int goal, int *x, int *y) {
+  //with nothing left to explore on this island the survey would search all of it to find that out
+  int frontier = goal_frontier(goal);
+  if(frontier != NO_FRONTIER && !frontier_open(ctx, frontier, ctx->agent.location)) return -1;
+  if(!ctx->survey.valid) survey_start(ctx);
+  ctx->survey.queries++;
+  while(ctx->survey.best[goal] > ctx->survey.settled + 1 && !queueEmpty(&ctx->survey.queue)) {
+    survey_step(ctx);
+  }
+  if(ctx->survey.best[goal] == MAX_DIST) return -1;
+  *x = ctx->survey.hit[goal].x;
+  *y = ctx->survey.hit[goal].y;
+  return ctx->survey.best[goal];
+}
+
+//the survey is only good for the map and agent it started with
+void survey_invalidate(AgentContext *ctx) {
+  ctx->survey.valid = false;
+}
+
+//the cost of stepping into a space we have seen from where the agent is this turn (turns included),
+//or -1 if it can't be reached by land. The survey is carried on until the cost is final
+int field_cost(AgentContext *ctx, int x, int y) {
+  if(!ctx->survey.valid) survey_start(ctx);
+  if(x == ctx->agent.location.x && y == ctx->agent.location.y) return 0;
+  int cell = find_cell(ctx, x, y);
+  if(cell == NO_CELL) return -1;
+  while(!(ctx->survey.enterStamp[cell] == ctx->survey.epoch &&
+    ctx->survey.enterCost[cell] <= ctx->survey.settled + 1) && !queueEmpty(&ctx->survey.queue)) {
+    survey_step(ctx);
+  }
+  return ctx->survey.enterStamp[cell] == ctx->survey.epoch ? ctx->survey.enterCost[cell] : -1;
+}
+
+//save the cheapest way into a space as the current plan, read back from the field.
+//Spaces we haven't seen are only known to the field if a survey goal found them.
+//Returns the first action, or 0 if the field doesn't know a way there
+char field_route(AgentContext *ctx, int x, int y) {
+  int from = NO_STATE;
+  if(find_cell(ctx, x, y) != NO_CELL) {
+    if(field_cost(ctx, x, y) > 0) from = ctx->survey.enterFrom[find_cell(ctx, x, y)];
+  } else if(ctx->survey.valid) {
+    int goal;
+    for(goal = 0; goal < NUM_GOALS; goal++) {
+      if(ctx->survey.best[goal] != MAX_DIST && ctx->survey.hit[goal].x == x &&
+        ctx->survey.hit[goal].y == y && ctx->survey.best[goal] <= ctx->survey.settled + 1) {
+        from = ctx->survey.from[goal];
+      }
+    }
+  }
+  if(from == NO_STATE) return 0;
+  //the last state steps into the target (allocating it if we haven't seen it) before the path is laid out
+  int last = STATE(x, y, STATE_DIR(from));
+  int length = 1;
+  int state;
+  for(state = from; state != ctx->survey.start; state = field_parent(ctx, state)) length++;
+  ctx->plan.path[length] = last;
+  int i = length - 1;
+  for(state = from; i >= 0; state = field_parent(ctx, state)) ctx->plan.path[i--] = state;
+  ctx->survey.routes++;
+  return store_plan(ctx, ctx->plan.path, length);
+}
+
+//the state the field reached a state from
+int field_parent(AgentContext *ctx, int state) {
+  int dir = STATE_DIR(state);
+  int cell = STATE_CELL(state);
+  switch(ctx->survey.move[state]) {
+    case 'f': {
+      int behindX, behindY;
+      result_of_move(cell_x(ctx, cell), cell_y(ctx, cell), (dir + 2) % 4, &behindX, &behindY);
+      return find_cell(ctx, behindX, behindY) * NUM_DIRECTIONS + dir;
+    }
+    case 'r':
+      return cell * NUM_DIRECTIONS + (dir + 3) % 4;
+    default:
+      return cell * NUM_DIRECTIONS + (dir + 1) % 4;
+  }
+}
+
+void survey_grow(AgentContext *ctx, int oldCells, int newCells) {
+  ctx->survey.stamp = grow_array(ctx, ctx->survey.stamp, sizeof(unsigned int),
+    oldCells * NUM_DIRECTIONS, newCells * NUM_DIRECTIONS);
+  ctx->survey.cost = grow_array(ctx, ctx->survey.cost, sizeof(int),
+    oldCells * NUM_DIRECTIONS, newCells * NUM_DIRECTIONS);
+  ctx->survey.move = grow_array(ctx, ctx->survey.move, sizeof(char),
+    oldCells * NUM_DIRECTIONS, newCells * NUM_DIRECTIONS);
+  ctx->survey.enterStamp = grow_array(ctx, ctx->survey.enterStamp, sizeof(unsigned int),
+    oldCells, newCells);
+  ctx->survey.enterCost = grow_array(ctx, ctx->survey.enterCost, sizeof(int), oldCells, newCells);
+  ctx->survey.enterFrom = grow_array(ctx, ctx->survey.enterFrom, sizeof(int), oldCells, newCells);
+  ctx->survey.entered = grow_array(ctx, ctx->survey.entered, sizeof(int), oldCells, newCells);
+  //a tile allocated mid survey has no states queued yet, so carrying on is still fine
+}
+
+//the survey goal for a closest_reachable() type, NO_GOAL if it has to be searched for the old way
+int type_goal(int type) {
+  switch(type) {
+    case UNSEEN:
+      return GOAL_UNSEEN;
+    case PERIMETER:
+      return GOAL_PERIMETER;
+    case 'T':
+      return GOAL_TREE;
+    case 'o':
+      return GOAL_STONE;
+    case '~':
+      return GOAL_WATER;
+  }
+  return NO_GOAL;
+}
+
+//a space on the world map has changed, tell everything planned using it
+void space_changed(AgentContext *ctx, int x, int y) {
+  plan_space_changed(ctx, x, y);
+  dstar_space_changed(ctx, &ctx->routePlanner, x, y);
+}
+
+//Incremental planner (D* Lite) over the (x, y, direction) state lattice: a state is a space plus the direction
+//the agent is facing in it, so turning costs are exact. Stepping forward and each 90 degree turn cost 1.
+//It searches backwards from the goal so the costs it has found stay valid as the agent moves, and
+//when spaces change only the states whose cost depends on them are repaired on the next dstar_plan().
+//Costs are only valid for states stamped with the planner's current generation, so starting a new
+//search is just a generation increment rather than clearing every array.
+void dstar_reset(AgentContext *ctx, DStar *d, SearchSpec *spec) {
+  d->spec = *spec;
+  d->active = true;
+  d->generation++;
+  d->heapSize = 0;
+  d->km = 0;
+  d->lastStart = NO_STATE;
+  d->key = ctx->agent.key;
+  d->axe = ctx->agent.axe;
+  d->resets++;
+  //every goal state costs nothing to reach the goal from
+  dstar_update_space(ctx, d, spec->targetX, spec->targetY);
+}
+
+//make room for the states of newly allocated spaces
+void dstar_grow(AgentContext *ctx, DStar *d, int oldCells, int newCells) {
+  int from = oldCells * NUM_DIRECTIONS;
+  int to = newCells * NUM_DIRECTIONS;
+  d->stamp = grow_array(ctx, d->stamp, sizeof(int), from, to);
+  d->g = grow_array(ctx, d->g, sizeof(int), from, to);
+  d->rhs = grow_array(ctx, d->rhs, sizeof(int), from, to);
+  d->key1 = grow_array(ctx, d->key1, sizeof(int), from, to);
+  d->key2 = grow_array(ctx, d->key2, sizeof(int), from, to);
+  d->heapPos = grow_array(ctx, d->heapPos, sizeof(int), from, to);
+  d->heap = grow_array(ctx, d->heap, sizeof(int), from, to);
+}
+
+//update every state the planner uses for a space
+void dstar_update_space(AgentContext *ctx, DStar *d, int x, int y) {
+  int dir;
+  for(dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    dstar_update_vertex(ctx, d, STATE(x, y, dir));
+  }
+}
+
+//repair the planner's costs and bring them up to date for the given start state.
+//Returns the cost of the cheapest path from start to the goal (DSTAR_INF if there is none)
+int dstar_plan(AgentContext *ctx, DStar *d, SearchSpec *spec, int start) {
+  if(!d->active || !same_spec(&d->spec, spec)) dstar_reset(ctx, d, spec);
+  //new tools change which doors (and trees) can be passed
+  if(d->key != ctx->agent.key || d->axe != ctx->agent.axe) {
+    d->key = ctx->agent.key;
+    d->axe = ctx->agent.axe;
+    int cell;
+    for(cell = 0; cell < ctx->world.numTiles * TILE_CELLS; cell++) {
+      if(ctx->world.symbols[cell] == '-' || ctx->world.symbols[cell] == 'T') {
+        dstar_space_changed(ctx, d, cell_x(ctx, cell), cell_y(ctx, cell));
+      }
+    }
+  }
+  //keys are relative to the start, moving it lowers every heuristic by at most the distance moved
+  if(d->lastStart != NO_STATE) {
+    d->km += dstar_heuristic(ctx, d->lastStart, start);
+  }
+  d->lastStart = start;
+
+  int keyStart[2];
+  dstar_key(ctx, d, start, keyStart);
+  while(d->heapSize > 0 &&
+    (key_less(d->key1[d->heap[0]], d->key2[d->heap[0]], keyStart[0],
+    keyStart[1]) || dstar_rhs(d, start) != dstar_g(d, start))) {
+    //out of time, the queue is left as it is for the next turn to carry on from
+    if(deadline_passed(ctx)) return DSTAR_INF;
+
+    int u = d->heap[0];
+    int oldKey[2] = {d->key1[u], d->key2[u]};
+    int newKey[2];
+    dstar_key(ctx, d, u, newKey);
+    d->expansions++;
+    if(key_less(oldKey[0], oldKey[1], newKey[0], newKey[1])) {
+      heap_set(ctx, d, u, newKey);
+    } else if(dstar_g(d, u) > dstar_rhs(d, u)) {
+      d->g[u] = d->rhs[u];
+      heap_remove(d, u);
+      dstar_update_predecessors(ctx, d, u);
+    } else {
+      d->g[u] = DSTAR_INF;
+      dstar_update_vertex(ctx, d, u);
+      dstar_update_predecessors(ctx, d, u);
+    }
+    dstar_key(ctx, d, start, keyStart);
+  }
+  return dstar_rhs(d, start);
+}
+
+//a space changed. The forward moves into it (and if it is a goal, its own states) may now cost something else
+void dstar_space_changed(AgentContext *ctx, DStar *d, int x, int y) {
+  if(!d->active) return;
+  int dir;
+  for(dir = 0; dir < NUM_DIRECTIONS; dir++) {
+    int fromX, fromY;
+    result_of_move(x, y, (dir + 2) % 4, &fromX, &fromY);
+    dstar_update_vertex(ctx, d, STATE(fromX, fromY, dir));
+  }
+  dstar_update_space(ctx, d, x, y);
+}
+
+//the state after the cheapest move out of this one, or NO_STATE if no move leads to the goal
+int dstar_next_state(AgentContext *ctx, DStar *d, int state) {
+  int best = NO_STATE;
+  int bestCost = DSTAR_INF;
+  int i;
+  for(i = 0; i < 3; i++) {
+    int cost;
+    int next = dstar_successor(ctx, d, state, i, &cost);
+    if(next == NO_STATE) continue;
+    if(cost + dstar_g(d, next) < bestCost) {
+      bestCost = cost + dstar_g(d, next);
+      best = next;
+    }
+  }
+  return best;
+}
+
+//follow the planner's costs from start to the goal and save the route as the current plan.
+//Returns the first action (0 if the start is already at the goal)
+char dstar_map_path(AgentContext *ctx, DStar *d, int start) {
+  int length = 0;
+  ctx->plan.path[0] = start;
+  while(!is_search_goal(&d->spec, STATE_X(ctx->plan.path[length]),
+    STATE_Y(ctx->plan.path[length]))) {
+    int next = dstar_next_state(ctx, d, ctx->plan.path[length]);
+    if(next == NO_STATE || length + 1 == NUM_STATES) return 0;
+    ctx->plan.path[++length] = next;
+  }
+  if(length == 0) return 0;
+  return store_plan(ctx, ctx->plan.path, length);
+}
+
+//the i'th move out of a state (forward, turn right, turn left) and its cost
+int dstar_successor(AgentContext *ctx, DStar *d, int state, int i, int *cost) {
+  int x = STATE_X(state);
+  int y = STATE_Y(state);
+  int dir = STATE_DIR(state);
+  *cost = 1;
+  switch(i) {
+    case 0:
+      result_of_move(x, y, dir, &x, &y);
+      if(!lattice_enterable(ctx, &d->spec, x, y)) return NO_STATE;
+      return STATE(x, y, dir);
+    case 1:
+      return STATE(x, y, (dir + 1) % 4);
+    default:
+      return STATE(x, y, (dir + 3) % 4);
+  }
+}
+
+//recompute the lookahead cost of a state from its successors and queue it if it is inconsistent
+void dstar_update_vertex(AgentContext *ctx, DStar *d, int u) {
+  dstar_touch(d, u);
+  if(is_search_goal(&d->spec, STATE_X(u), STATE_Y(u))) {
+    d->rhs[u] = 0;
+  } else {
+    int best = DSTAR_INF;
+    int i;
+    for(i = 0; i < 3; i++) {
+      int cost;
+      int next = dstar_successor(ctx, d, u, i, &cost);
+      if(next == NO_STATE) continue;
+      if(cost + dstar_g(d, next) < best) best = cost + dstar_g(d, next);
+    }
+    d->rhs[u] = best;
+  }
+  if(d->g[u] != d->rhs[u]) {
+    int key[2];
+    dstar_key(ctx, d, u, key);
+    heap_set(ctx, d, u, key);
+  } else if(d->heapPos[u] != NO_NODE) {
+    heap_remove(d, u);
+  }
+}
+
+//every state with a move into u: forward from the space behind, or turning on the spot
+void dstar_update_predecessors(AgentContext *ctx, DStar *d, int u) {
+  int x = STATE_X(u);
+  int y = STATE_Y(u);
+  int dir = STATE_DIR(u);
+  int fromX, fromY;
+  result_of_move(x, y, (dir + 2) % 4, &fromX, &fromY);
+  if(lattice_enterable(ctx, &d->spec, x, y)) {
+    dstar_update_vertex(ctx, d, STATE(fromX, fromY, dir));
+  }
+  dstar_update_vertex(ctx, d, STATE(x, y, (dir + 1) % 4));
+  dstar_update_vertex(ctx, d, STATE(x, y, (dir + 3) % 4));
+}
+
+//states from an older search are treated as never seen
+void dstar_touch(DStar *d, int u) {
+  if(d->stamp[u] == d->generation) return;
+  d->stamp[u] = d->generation;
+  d->g[u] = DSTAR_INF;
+  d->rhs[u] = DSTAR_INF;
+  d->heapPos[u] = NO_NODE;
+}
+
+int dstar_g(DStar *d, int u) {
+  return d->stamp[u] == d->generation ? d->g[u] : DSTAR_INF;
+}
+
+int dstar_rhs(DStar *d, int u) {
+  return d->stamp[u] == d->generation ? d->rhs[u] : DSTAR_INF;
+}
+
+//manhattan distance between two states, a lower bound on the cost between them
+int dstar_heuristic(AgentContext *ctx, int from, int to) {
+  return abs(STATE_X(from) - STATE_X(to)) + abs(STATE_Y(from) - STATE_Y(to));
+}
+
+void dstar_key(AgentContext *ctx, DStar *d, int u, int key[2]) {
+  int g = dstar_g(d, u);
+  int rhs = dstar_rhs(d, u);
+  int best = g < rhs ? g : rhs;
+  if(best >= DSTAR_INF) {
+    key[0] = DSTAR_INF;
+    key[1] = DSTAR_INF;
+    return;
+  }
+  key[0] = best + dstar_heuristic(ctx, d->lastStart == NO_STATE ? u :
+    d->lastStart, u) + d->km;
+  key[1] = best;
+}
+
+bool key_less(int a1, int a2, int b1, int b2) {
+  return a1 < b1 || (a1 == b1 && a2 < b2);
+}
+
+bool same_spec(SearchSpec *a, SearchSpec *b) {
+  return a->waterSearch == b->waterSearch && a->islandTime == b->islandTime &&
+    a->targetX == b->targetX && a->targetY == b->targetY;
+}
+
+//binary heap of states ordered by their keys, heapPos lets a state's key be changed or removed in place
+static void heap_swap(DStar *d, int i, int j) {
+  int tmp = d->heap[i];
+  d->heap[i] = d->heap[j];
+  d->heap[j] = tmp;
+  d->heapPos[d->heap[i]] = i;
+  d->heapPos[d->heap[j]] = j;
+}
+
+static bool heap_less(DStar *d, int i, int j) {
+  return key_less(d->key1[d->heap[i]], d->key2[d->heap[i]],
+    d->key1[d->heap[j]], d->key2[d->heap[j]]);
+}
+
+static void heap_sift(DStar *d, int i) {
+  while(i > 0 && heap_less(d, i, (i - 1) / 2)) {
+    heap_swap(d, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  while(1) {
+    int smallest = i;
+    int child;
+    for(child = 2 * i + 1; child <= 2 * i + 2; child++) {
+      if(child < d->heapSize && heap_less(d, child, smallest)) smallest = child;
+    }
+    if(smallest == i) return;
+    heap_swap(d, i, smallest);
+    i = smallest;
+  }
+}
+
+//insert a state or change its key
+void heap_set(AgentContext *ctx, DStar *d, int u, int key[2]) {
+  d->key1[u] = key[0];
+  d->key2[u] = key[1];
+  if(d->heapPos[u] == NO_NODE) {
+    assert(d->heapSize < NUM_STATES);
+    d->heap[d->heapSize] = u;
+    d->heapPos[u] = d->heapSize++;
+  }
+  heap_sift(d, d->heapPos[u]);
+}
+
+void heap_remove(DStar *d, int u) {
+  int i = d->heapPos[u];
+  if(i == NO_NODE) return;
+  d->heapSize--;
+  if(i != d->heapSize) {
+    heap_swap(d, i, d->heapSize);
+    d->heapPos[u] = NO_NODE;
+    heap_sift(d, i);
+  } else d->heapPos[u] = NO_NODE;
+}
+
+//the one queue shared by every search of a context (searchQueue). Searches never overlap so its buckets and
+//node pool can be reused from search to search instead of being reallocated.
+
+//take a node from the pool, recycling a popped node if there is one
+static int newNode(Queue q, int xPos, int yPos, int dir,
+  int distFromStart, int heuristicCost) {
+
+  int node = q->freeNodes;
+  if(node != NO_NODE) {
+    q->freeNodes = q->pool[node].next;
+  } else {
+    if(q->nodesUsed == q->poolSize) {
+      q->poolSize = q->poolSize ? q->poolSize * 2 : INITIAL_POOL_SIZE;
+      q->pool = realloc(q->pool, q->poolSize * sizeof(searchNode));
+      assert(q->pool != NULL);
+    }
+    node = q->nodesUsed++;
+  }
+  q->pool[node].xPos = xPos;
+  q->pool[node].yPos = yPos;
+  q->pool[node].dir = dir; 
+  q->pool[node].distFromStart = distFromStart;
+  q->pool[node].heuristicCost = heuristicCost;
+  q->pool[node].next = NO_NODE;
+  return node;
+}
+
+//create queue (really just hands out the shared queue, emptied)
+Queue newQueue(AgentContext *ctx) {
+  Queue q = &ctx->searchQueue;
+  assert(!ctx->searchQueueInUse);
+  ctx->searchQueueInUse = true;
+  queue_reset(q);
+  return q;
+}
+
+//free queue. The pool is kept for the next search
+void disposeQueue(AgentContext *ctx, Queue q) {
+  if (q == NULL) return;
+  queue_empty_buckets(q);
+  ctx->searchQueueInUse = false;
+}
+
+//ready a queue with empty buckets for a new search
+void queue_reset(Queue q) {
+  if(q->pool == NULL) {
+    int i;
+    for(i = 0; i < NUM_BUCKETS; i++) q->bucket[i] = NO_NODE;
+  }
+  q->minBucket = NUM_BUCKETS;
+  q->maxBucket = -1;
+  q->size = 0;
+  q->freeNodes = NO_NODE;
+  q->nodesUsed = 0;
+}
+
+//only the buckets that were touched need emptying
+void queue_empty_buckets(Queue q) {
+  int i;
+  for(i = q->minBucket; i <= q->maxBucket; i++) q->bucket[i] = NO_NODE;
+  q->size = 0;
+}
+
+bool queueEmpty(Queue q) {
+  return q->size == 0;
+}
+
+//pop a node with the lowest priority from the queue
+void popFrom(Queue q, int *xPos, int *yPos, int *dir,
+  int *distFromStart, int *heuristicCost) {
+
+  assert (q != NULL && q->size > 0);
+  int old = q->bucket[q->minBucket];
+    *xPos = q->pool[old].xPos;
+    *yPos = q->pool[old].yPos;
+    *dir = q->pool[old].dir;
+    *distFromStart = q->pool[old].distFromStart;
+    *heuristicCost = q->pool[old].heuristicCost;
+  q->bucket[q->minBucket] = q->pool[old].next;
+  disposeNode(q, old);
+  q->size--;
+  //keep minBucket pointing at the top of the queue
+  while(q->size > 0 && q->bucket[q->minBucket] == NO_NODE) q->minBucket++;
+  return;
+}
+
+//push a new node onto the queue. Prioritised by heuristic cost, most recent first within a priority
+//except that the node at the top of the queue keeps its place (same ordering as the old sorted list)
+void pushOnto(Queue q, int xPos, int yPos, int dir,
+  int distFromStart, int heuristicCost) {
+
+  assert(heuristicCost >= 0 && heuristicCost < NUM_BUCKETS);
+  int new = newNode(q, xPos, yPos, dir, distFromStart, heuristicCost);
+  int top = q->bucket[heuristicCost];
+  if(top != NO_NODE && heuristicCost == q->minBucket) {
+    q->pool[new].next = q->pool[top].next;
+    q->pool[top].next = new;
+  } else {
+    q->pool[new].next = top;
+    q->bucket[heuristicCost] = new;
+  }
+  if(q->size == 0 || heuristicCost < q->minBucket) q->minBucket = heuristicCost;
+  if(heuristicCost > q->maxBucket) q->maxBucket = heuristicCost;
+  q->size++;
+  return;
+}
+
+//return node to the pool
+static void disposeNode(Queue q, int node) {
+  assert(node != NO_NODE);
+  q->pool[node].next = q->freeNodes;
+  q->freeNodes = node;
+}
+
+//The world map is stored sparsely: spaces are grouped into TILE_SIZE x TILE_SIZE tiles which are only
+//allocated once something in them is needed, so memory grows with the area explored rather than the
+//largest world we might be dropped into. Each allocated space gets a cell index (tile slot * TILE_CELLS +
+//its place in the tile) and every per space array, the map itself and the search scratch arrays alike,
+//is indexed by it and grows along with the store.
+
+//the slot of the tile at the given tile position, or NO_TILE if it hasn't been allocated
+static int find_tile(AgentContext *ctx, int tileX, int tileY) {
+  if(ctx->world.numTiles == 0) return NO_TILE;
+  if(tileCache.slot != NO_TILE && tileCache.store == ctx->world.id && tileX == tileCache.tileX &&
+    tileY == tileCache.tileY) return tileCache.slot;
+  unsigned int h = tile_hash(tileX, tileY, ctx->world.directorySize);
+  while(ctx->world.directory[h] != NO_TILE) {
+    int slot = ctx->world.directory[h];
+    if(ctx->world.tileOrigin[slot].x == tileX * TILE_SIZE &&
+      ctx->world.tileOrigin[slot].y == tileY * TILE_SIZE) {
+      tileCache.store = ctx->world.id;
+      tileCache.tileX = tileX;
+      tileCache.tileY = tileY;
+      tileCache.slot = slot;
+      return slot;
+    }
+    h = (h + 1) & (ctx->world.directorySize - 1);
+  }
+  return NO_TILE;
+}
+
+//open addressing hash of a tile position into a directory of the given (power of 2) size
+unsigned int tile_hash(int tileX, int tileY, int size) {
+  return ((unsigned int)tileX * 73856093u ^ (unsigned int)tileY * 19349663u) &
+    (size - 1);
+}
+
+static void directory_insert(AgentContext *ctx, int slot) {
+  unsigned int h = tile_hash(TILE_OF(ctx->world.tileOrigin[slot].x),
+    TILE_OF(ctx->world.tileOrigin[slot].y), ctx->world.directorySize);
+  while(ctx->world.directory[h] != NO_TILE) h = (h + 1) & (ctx->world.directorySize - 1);
+  ctx->world.directory[h] = slot;
+}
+
+//allocate the tile at a tile position, growing the directory and every cell array if they are full
+static int new_tile(AgentContext *ctx, int tileX, int tileY) {
+  if(2 * (ctx->world.numTiles + 1) > ctx->world.directorySize) {
+    ctx->world.directorySize = ctx->world.directorySize ? ctx->world.directorySize * 2 :
+      INITIAL_DIRECTORY_SIZE;
+    ctx->world.directory = realloc(ctx->world.directory,
+      ctx->world.directorySize * sizeof(int));
+    assert(ctx->world.directory != NULL);
+    int i;
+    for(i = 0; i < ctx->world.directorySize; i++) ctx->world.directory[i] = NO_TILE;
+    for(i = 0; i < ctx->world.numTiles; i++) directory_insert(ctx, i);
+  }
+  if(ctx->world.numTiles == ctx->world.capacity) {
+    int oldCells = NUM_CELLS;
+    ctx->world.capacity = ctx->world.capacity ? ctx->world.capacity * 2 : INITIAL_TILES;
+    ctx->world.tileOrigin = realloc(ctx->world.tileOrigin,
+      ctx->world.capacity * sizeof(Coords));
+    assert(ctx->world.tileOrigin != NULL);
+    ctx->world.planes = grow_array(ctx, ctx->world.planes,
+      NUM_PLANES * TILE_SIZE * sizeof(unsigned int), oldCells / TILE_CELLS,
+      ctx->world.capacity);
+    grow_cell_arrays(ctx, oldCells, NUM_CELLS);
+  }
+  int slot = ctx->world.numTiles++;
+  ctx->world.tileOrigin[slot].x = tileX * TILE_SIZE;
+  ctx->world.tileOrigin[slot].y = tileY * TILE_SIZE;
+  //nothing in a new tile has been seen yet
+  memset(PLANE_ROWS(slot, PLANE_UNSEEN), 0xff, TILE_SIZE * sizeof(unsigned int));
+  directory_insert(ctx, slot);
+  tileCache.store = ctx->world.id;
+  tileCache.tileX = tileX;
+  tileCache.tileY = tileY;
+  tileCache.slot = slot;
+  return slot;
+}
+
+//the cell index of a space, or NO_CELL if it is in a tile that hasn't been allocated.
+//Never allocates, so it is safe to call in the middle of a flood fill
+int find_cell(AgentContext *ctx, int x, int y) {
+  int slot = find_tile(ctx, TILE_OF(x), TILE_OF(y));
+  if(slot == NO_TILE) return NO_CELL;
+  return slot * TILE_CELLS + IN_TILE(y) * TILE_SIZE + IN_TILE(x);
+}
+
+//the cell index of a space, allocating its tile if needed
+int cell_index(AgentContext *ctx, int x, int y) {
+  int slot = find_tile(ctx, TILE_OF(x), TILE_OF(y));
+  if(slot == NO_TILE) slot = new_tile(ctx, TILE_OF(x), TILE_OF(y));
+  return slot * TILE_CELLS + IN_TILE(y) * TILE_SIZE + IN_TILE(x);
+}
+
+int cell_x(AgentContext *ctx, int cell) {
+  return ctx->world.tileOrigin[cell / TILE_CELLS].x + cell % TILE_SIZE;
+}
+
+int cell_y(AgentContext *ctx, int cell) {
+  return ctx->world.tileOrigin[cell / TILE_CELLS].y + (cell % TILE_CELLS) / TILE_SIZE;
+}
+
+//what we have seen at a space, 0 if we haven't seen it
+char wmap_at(AgentContext *ctx, int x, int y) {
+  int cell = find_cell(ctx, x, y);
+  return cell == NO_CELL ? 0 : ctx->world.symbols[cell];
+}
+
+//keeps the tile's bitplanes and the island sets in step with its symbols
+void set_wmap(AgentContext *ctx, int x, int y, char symbol) {
+  int cell = cell_index(ctx, x, y);
+  int slot = cell / TILE_CELLS;
+  unsigned int bit = 1u << IN_TILE(x);
+  int plane = symbol_plane(ctx->world.symbols[cell]);
+  if(plane != NO_PLANE) PLANE_ROWS(slot, plane)[IN_TILE(y)] &= ~bit;
+  plane = symbol_plane(symbol);
+  if(plane != NO_PLANE) PLANE_ROWS(slot, plane)[IN_TILE(y)] |= bit;
+  ctx->world.symbols[cell] = symbol;
+}
+
+//the island a space was labelled with by create_islandMap(), 0 if none
+int island_at(AgentContext *ctx, int x, int y) {
+  int cell = find_cell(ctx, x, y);
+  return cell == NO_CELL ? 0 : ctx->world.islands[cell];
+}
+
+void set_island(AgentContext *ctx, int x, int y, int island) {
+  int cell = cell_index(ctx, x, y);
+  ctx->world.islands[cell] = island;
+}
+
+//has the agent stood on this space
+int been_at(AgentContext *ctx, int x, int y) {
+  int cell = find_cell(ctx, x, y);
+  return cell == NO_CELL ? 0 : ctx->world.been[cell];
+}
+
+void set_been(AgentContext *ctx, int x, int y, int been) {
+  int cell = cell_index(ctx, x, y);
+  ctx->world.been[cell] = been;
+}
+
+//resize an array indexed by cell (or state) from oldCount to newCount elements, zeroing the new ones
+void *grow_array(AgentContext *ctx, void *array, size_t size, int oldCount, int newCount) {
+  array = realloc(array, newCount * size);
+  assert(array != NULL);
+  memset((char *)array + oldCount * size, 0, (newCount - oldCount) * size);
+  ctx->world.bytes += (long)(newCount - oldCount) * size;
+  return array;
+}
+
+//every array indexed by cell or state has to grow when the store does
+void grow_cell_arrays(AgentContext *ctx, int oldCells, int newCells) {
+  ctx->world.symbols = grow_array(ctx, ctx->world.symbols, sizeof(char), oldCells, newCells);
+  ctx->world.islands = grow_array(ctx, ctx->world.islands, sizeof(int), oldCells, newCells);
+  ctx->world.been = grow_array(ctx, ctx->world.been, sizeof(char), oldCells, newCells);
+  ctx->world.islandParent = grow_array(ctx, ctx->world.islandParent, sizeof(int), oldCells,
+    newCells);
+  ctx->world.islandSet = grow_array(ctx, ctx->world.islandSet, sizeof(int), oldCells, newCells);
+  survey_grow(ctx, oldCells, newCells);
+  pareto_grow(ctx, oldCells, newCells);
+  dstar_grow(ctx, &ctx->routePlanner, oldCells, newCells);
+  frontier_grow(ctx, oldCells, newCells);
+  workspace_grow(ctx, oldCells, newCells);
+  plan_grow(ctx, oldCells, newCells);
+}
+
+//prints how much of the world has been allocated and what it costs
+void print_map_stats(AgentContext *ctx, FILE *out) {
+  fprintf(out, "map store: %d tiles (%d spaces), %ld bytes in per space arrays (%ld per space)\n",
+    ctx->world.numTiles, ctx->world.numTiles * TILE_CELLS, ctx->world.bytes,
+    ctx->world.capacity ? ctx->world.bytes / NUM_CELLS : 0);
+  fprintf(out, "island sets: %d islands, %ld merges, %ld rebuilds\n",
+    ctx->islandSets.count, ctx->islandSets.unions, ctx->islandSets.rebuilds);
+  fprintf(out, "crossing graph: %ld rows built, %ld reused\n",
+    ctx->crossings.builds, ctx->crossings.reused);
+  fprintf(out, "hop planner: %ld trips planned in %ld searches (%ld islands expanded)\n",
+    ctx->hops.plans, ctx->hops.runs, ctx->hops.expansions);
+  fprintf(out, "thread pool: %ld jobs in %ld batches\n", ctx->pool.jobs, ctx->pool.batches);
+  print_frontier_stats(ctx, out);
+  fprintf(out, "view exploring: %ld places picked, %.1f unseen spaces in view at each\n",
+    ctx->viewStats.searches, ctx->viewStats.searches ? (double)ctx->viewStats.gain / ctx->viewStats.searches : 0.0);
+  fprintf(out, "change sets: %ld of %ld empty (%ld spaces seen, %ld changed, %ld items)\n",
+    ctx->changeSet.emptyTicks, ctx->changeSet.ticks, ctx->changeSet.seen, ctx->changeSet.changed, ctx->changeSet.items);
+}
+
+//Bitwise flood fills. Each tile keeps a bitplane per class of space (open land, water, unseen, trees,
+//stones and doors) alongside its symbols, so the spaces a flood fill may enter are a few ANDs and ORs
+//of whole rows. A flood fill steps a BitRegion outwards with shifts along each row and ORs between rows
+//(see region_step()), a TILE_SIZE row at a time instead of a space at a time.
+
+//which bitplane a symbol belongs to. Walls and the edge of the world are in none
+int symbol_plane(char symbol) {
+  switch(symbol) {
+    case '.': case '*': return NO_PLANE;
+    case '~': return PLANE_WATER;
+    case 0: return PLANE_UNSEEN;
+    case 'T': return PLANE_TREE;
+    case 'o': return PLANE_STONE;
+    case '-': return PLANE_DOOR;
+  }
+  return PLANE_OPEN;
+}
+
+//the rows of a tile a flood fill may enter: passable by land (as is_impassable()),
+//passable at island time (as is_impassable_island_time()) or anything we have seen
+void pass_rows(AgentContext *ctx, int slot, int mode, unsigned int mask[TILE_SIZE]) {
+  unsigned int *open = PLANE_ROWS(slot, PLANE_OPEN);
+  unsigned int *door = PLANE_ROWS(slot, PLANE_DOOR);
+  unsigned int *tree = PLANE_ROWS(slot, PLANE_TREE);
+  unsigned int *stone = PLANE_ROWS(slot, PLANE_STONE);
+  unsigned int *unseen = PLANE_ROWS(slot, PLANE_UNSEEN);
+  int y;
+  for(y = 0; y < TILE_SIZE; y++) {
+    switch(mode) {
+      case PASS_LAND:
+        mask[y] = open[y] | (ctx->agent.key ? door[y] : 0);
+        break;
+      case PASS_ISLAND:
+        mask[y] = open[y] | stone[y] | (ctx->agent.axe ? tree[y] : 0) |
+          (ctx->agent.key ? door[y] : 0);
+        break;
+      default:
+        mask[y] = ~unseen[y];
+    }
+  }
+}
+
+//empty a region. Tiles from before the epoch are treated as empty, so nothing is cleared
+void region_clear(AgentContext *ctx, BitRegion *r) {
+  r->epoch++;
+  if(r->epoch == 0) {
+    memset(r->stamp, 0, ctx->world.capacity * sizeof(*r->stamp));
+    r->epoch = 1;
+  }
+  r->numTiles = 0;
+}
+
+//the rows of a tile in the region, adding the tile (empty) if it isn't in it yet
+unsigned int *region_rows(BitRegion *r, int slot) {
+  if(r->stamp[slot] != r->epoch) {
+    r->stamp[slot] = r->epoch;
+    memset(&r->rows[slot * TILE_SIZE], 0, TILE_SIZE * sizeof(unsigned int));
+    r->tiles[r->numTiles++] = slot;
+  }
+  return &r->rows[slot * TILE_SIZE];
+}
+
+//the rows of a tile in the region, or NULL if none of it is
+unsigned int *region_peek(BitRegion *r, int slot) {
+  return r->stamp[slot] == r->epoch ? &r->rows[slot * TILE_SIZE] : NULL;
+}
+
+void region_add(AgentContext *ctx, BitRegion *r, int x, int y) {
+  int slot = find_tile(ctx, TILE_OF(x), TILE_OF(y));
+  assert(slot != NO_TILE);
+  region_rows(r, slot)[IN_TILE(y)] |= 1u << IN_TILE(x);
+}
+
+//the bits a tile's rows pass over their edge facing dir, as rows of the neighbouring tile.
+//Returns the neighbour's slot, or NO_TILE if it was never allocated
+int edge_rows(AgentContext *ctx, int slot, unsigned int rows[TILE_SIZE], int dir,
+  unsigned int edge[TILE_SIZE]) {
+  int neighbourX, neighbourY;
+  result_of_move(TILE_OF(ctx->world.tileOrigin[slot].x), TILE_OF(ctx->world.tileOrigin[slot].y),
+    dir, &neighbourX, &neighbourY);
+  int neighbour = find_tile(ctx, neighbourX, neighbourY);
+  if(neighbour == NO_TILE) return NO_TILE;
+  int y;
+  for(y = 0; y < TILE_SIZE; y++) {
+    switch(dir) {
+      case UP:
+        edge[y] = y == TILE_SIZE - 1 ? rows[0] : 0;
+        break;
+      case DOWN:
+        edge[y] = y == 0 ? rows[TILE_SIZE - 1] : 0;
+        break;
+      case LEFT:
+        edge[y] = (rows[y] & 1) << (TILE_SIZE - 1);
+        break;
+      default:
+        edge[y] = rows[y] >> (TILE_SIZE - 1);
+    }
+  }
+  return neighbour;
+}
+
+//one step of a breadth first flood: next becomes every space next to the frontier that hasn't
+//been discovered yet (whether or not it can be entered), and those spaces are added to discovered
+void region_step(AgentContext *ctx, BitRegion *frontier, BitRegion *discovered, BitRegion *next) {
+  region_clear(ctx, next);
+  int t, y, dir;
+  for(t = 0; t < frontier->numTiles; t++) {
+    int slot = frontier->tiles[t];
+    unsigned int *rows = region_peek(frontier, slot);
+    unsigned int *nextRows = region_rows(next, slot);
+    for(y = 0; y < TILE_SIZE; y++) {
+      nextRows[y] |= rows[y] << 1 | rows[y] >> 1;
+      if(y > 0) nextRows[y] |= rows[y - 1];
+      if(y < TILE_SIZE - 1) nextRows[y] |= rows[y + 1];
+    }
+    for(dir = 0; dir < 4; dir++) {
+      unsigned int edge[TILE_SIZE];
+      int neighbour = edge_rows(ctx, slot, rows, dir, edge);
+      if(neighbour == NO_TILE) continue;
+      nextRows = region_rows(next, neighbour);
+      for(y = 0; y < TILE_SIZE; y++) nextRows[y] |= edge[y];
+    }
+  }
+  for(t = 0; t < next->numTiles; t++) {
+    int slot = next->tiles[t];
+    unsigned int *nextRows = region_peek(next, slot);
+    unsigned int *discoveredRows = region_rows(discovered, slot);
+    for(y = 0; y < TILE_SIZE; y++) {
+      nextRows[y] &= ~discoveredRows[y];
+      discoveredRows[y] |= nextRows[y];
+    }
+  }
+}
+
+//keep only the spaces of the region that mode lets a flood fill enter. Returns false if that leaves it empty
+bool region_mask(AgentContext *ctx, BitRegion *r, int mode) {
+  bool any = false;
+  int t, y;
+  for(t = 0; t < r->numTiles; t++) {
+    int slot = r->tiles[t];
+    unsigned int mask[TILE_SIZE];
+    unsigned int *rows = region_peek(r, slot);
+    pass_rows(ctx, slot, mode, mask);
+    for(y = 0; y < TILE_SIZE; y++) {
+      rows[y] &= mask[y];
+      if(rows[y]) any = true;
+    }
+  }
+  return any;
+}
+
+//list the spaces of the region that are in the given bitplane (every space for NO_PLANE).
+//Returns how many there are
+int region_spaces(AgentContext *ctx, BitRegion *r, int plane, Coords spaces[]) {
+  int count = 0;
+  int t, y;
+  for(t = 0; t < r->numTiles; t++) {
+    int slot = r->tiles[t];
+    unsigned int *rows = region_peek(r, slot);
+    for(y = 0; y < TILE_SIZE; y++) {
+      unsigned int bits = rows[y];
+      if(plane != NO_PLANE) bits &= PLANE_ROWS(slot, plane)[y];
+      while(bits) {
+        spaces[count].x = ctx->world.tileOrigin[slot].x + __builtin_ctz(bits);
+        spaces[count].y = ctx->world.tileOrigin[slot].y + y;
+        count++;
+        bits &= bits - 1;
+      }
+    }
+  }
+  return count;
+}
+
+//make room for the rows of newly allocated tiles
+void region_grow(AgentContext *ctx, BitRegion *r, int oldTiles, int newTiles) {
+  r->stamp = grow_array(ctx, r->stamp, sizeof(unsigned int), oldTiles, newTiles);
+  r->rows = grow_array(ctx, r->rows, TILE_SIZE * sizeof(unsigned int), oldTiles, newTiles);
+  r->tiles = grow_array(ctx, r->tiles, sizeof(int), oldTiles, newTiles);
+}
+
+//The thread pool. NUM_WORKERS threads are started the first time there is work for them and then wait for
+//batches: a job function and a count. Jobs are handed out in order from a shared counter and the calling
+//thread takes its share too, so a batch is done when every job has finished. Each worker has its own
+//workspace (after the ones used as a stack) and its own tile cache, so a job may only read the map and
+//write what belongs to it. Which thread runs a job doesn't change what it does.
+//A pool belongs to one context and its threads plan for that context only, until pool_stop(). A serial pool
+//(see agent_serial()) starts no threads and the calling thread runs every job itself.
+
+//run jobs 0 to numJobs - 1 of a batch across the pool and wait for them all
+void pool_run(AgentContext *ctx, int numJobs, void (*job)(AgentContext *ctx, int job, Workspace *ws)) {
+  int i;
+  if(!ctx->pool.started) {
+    pthread_mutex_init(&ctx->pool.lock, NULL);
+    pthread_cond_init(&ctx->pool.work, NULL);
+    pthread_cond_init(&ctx->pool.done, NULL);
+    for(i = 0; i < NUM_WORKERS && !ctx->pool.serial; i++) {
+      ctx->pool.workers[i].owner = ctx;
+      ctx->pool.workers[i].id = i;
+      if(pthread_create(&ctx->pool.threads[i], NULL, pool_worker, &ctx->pool.workers[i]) != 0) {
+        perror("pthread_create");
+        exit(1);
+      }
+    }
+    ctx->pool.started = true;
+  }
+  pthread_mutex_lock(&ctx->pool.lock);
+  ctx->pool.job = job;
+  ctx->pool.numJobs = numJobs;
+  ctx->pool.nextJob = 0;
+  ctx->pool.finished = 0;
+  ctx->pool.batch++;
+  ctx->pool.batches++;
+  ctx->pool.jobs += numJobs;
+  pthread_cond_broadcast(&ctx->pool.work);
+  pthread_mutex_unlock(&ctx->pool.lock);
+
+  Workspace *ws = acquire_workspace(ctx);
+  pool_work(ctx, ws);
+  release_workspace(ctx, ws);
+
+  pthread_mutex_lock(&ctx->pool.lock);
+  while(ctx->pool.finished < ctx->pool.numJobs) pthread_cond_wait(&ctx->pool.done, &ctx->pool.lock);
+  pthread_mutex_unlock(&ctx->pool.lock);
+}
+
+//take jobs from the current batch until there are none left
+void pool_work(AgentContext *ctx, Workspace *ws) {
+  while(true) {
+    pthread_mutex_lock(&ctx->pool.lock);
+    int job = ctx->pool.nextJob < ctx->pool.numJobs ? ctx->pool.nextJob++ : -1;
+    pthread_mutex_unlock(&ctx->pool.lock);
+    if(job == -1) return;
+    workspace_begin(ctx, ws);
+    ctx->pool.job(ctx, job, ws);
+    pthread_mutex_lock(&ctx->pool.lock);
+    if(++ctx->pool.finished == ctx->pool.numJobs) pthread_cond_signal(&ctx->pool.done);
+    pthread_mutex_unlock(&ctx->pool.lock);
+  }
+}
+
+//a worker thread, waiting for each new batch
+void *pool_worker(void *arg) {
+  PoolWorker *worker = arg;
+  AgentContext *ctx = worker->owner;
+  Workspace *ws = &ctx->workspaces[NUM_WORKSPACES + worker->id];
+  long batch = 0;
+  while(true) {
+    pthread_mutex_lock(&ctx->pool.lock);
+    while(ctx->pool.batch == batch && !ctx->pool.stopping) {
+      pthread_cond_wait(&ctx->pool.work, &ctx->pool.lock);
+    }
+    bool stopping = ctx->pool.stopping;
+    batch = ctx->pool.batch;
+    pthread_mutex_unlock(&ctx->pool.lock);
+    if(stopping) return NULL;
+    pool_work(ctx, ws);
+  }
+  return NULL;
+}
+
+//end the worker threads, if they were started. Only called between batches
+void pool_stop(AgentContext *ctx) {
+  int i;
+  if(!ctx->pool.started) return;
+  pthread_mutex_lock(&ctx->pool.lock);
+  ctx->pool.stopping = true;
+  pthread_cond_broadcast(&ctx->pool.work);
+  pthread_mutex_unlock(&ctx->pool.lock);
+  for(i = 0; i < NUM_WORKERS && !ctx->pool.serial; i++) pthread_join(ctx->pool.threads[i], NULL);
+  pthread_mutex_destroy(&ctx->pool.lock);
+  pthread_cond_destroy(&ctx->pool.work);
+  pthread_cond_destroy(&ctx->pool.done);
+  ctx->pool.started = false;
+}
+
+//hand out the next free workspace with an empty visited map.
+//workspaces are used like a stack so a flood fill can run another one inside it,
+//each must be released in reverse order
+Workspace *acquire_workspace(AgentContext *ctx) {
+  assert(ctx->workspacesInUse < NUM_WORKSPACES);
+  Workspace *ws = &ctx->workspaces[ctx->workspacesInUse++];
+  workspace_begin(ctx, ws);
+  ctx->workspaceStats.acquired++;
+  ctx->workspaceStats.tickBytes += (long)NUM_CELLS * sizeof(*ws->stamp);
+  if(ctx->workspacesInUse > ctx->workspaceStats.tickDepth) {
+    ctx->workspaceStats.tickDepth = ctx->workspacesInUse;
+  }
+  return ws;
+}
+
+//empty a workspace's visited map for a new flood fill
+void workspace_begin(AgentContext *ctx, Workspace *ws) {
+  ws->epoch++;
+  //the stamps from 2^32 searches ago would look visited again, so clear them once
+  if(ws->epoch == 0) {
+    memset(ws->stamp, 0, NUM_CELLS * sizeof(*ws->stamp));
+    ws->epoch = 1;
+  }
+}
+
+void release_workspace(AgentContext *ctx, Workspace *ws) {
+  assert(ctx->workspacesInUse > 0 && ws == &ctx->workspaces[ctx->workspacesInUse - 1]);
+  ctx->workspacesInUse--;
+}
+
+//has the flood fill using this workspace reached the space yet. Spaces that were
+//never allocated have not been seen, so they cannot have been visited either
+bool was_visited(AgentContext *ctx, Workspace *ws, int x, int y) {
+  int cell = find_cell(ctx, x, y);
+  return cell != NO_CELL && ws->stamp[cell] == ws->epoch;
+}
+
+//flood fills only ever visit spaces they have seen, which already have a cell
+void mark_visited(AgentContext *ctx, Workspace *ws, int x, int y) {
+  int cell = find_cell(ctx, x, y);
+  assert(cell != NO_CELL);
+  ws->stamp[cell] = ws->epoch;
+}
+
+void workspace_grow(AgentContext *ctx, int oldCells, int newCells) {
+  int i;
+  for(i = 0; i < NUM_WORKSPACES + NUM_WORKERS; i++) {
+    ctx->workspaces[i].stamp = grow_array(ctx, ctx->workspaces[i].stamp,
+      sizeof(unsigned int), oldCells, newCells);
+    ctx->workspaces[i].spaces = grow_array(ctx, ctx->workspaces[i].spaces, sizeof(Coords),
+      oldCells, newCells);
+    ctx->workspaces[i].from = grow_array(ctx, ctx->workspaces[i].from, sizeof(int),
+      oldCells, newCells);
+    ctx->workspaces[i].ports = grow_array(ctx, ctx->workspaces[i].ports, sizeof(PortCost),
+      oldCells, newCells);
+    int j;
+    for(j = 0; j < NUM_REGIONS; j++) {
+      region_grow(ctx, &ctx->workspaces[i].regions[j], oldCells / TILE_CELLS,
+        newCells / TILE_CELLS);
+    }
+  }
+}
+
+//called at the start of each turn to close off the counters for the last one
+void workspace_tick(AgentContext *ctx) {
+  assert(ctx->workspacesInUse == 0);
+  if(ctx->workspaceStats.tickBytes > ctx->workspaceStats.maxTickBytes) {
+    ctx->workspaceStats.maxTickBytes = ctx->workspaceStats.tickBytes;
+  }
+  if(ctx->workspaceStats.tickDepth > ctx->workspaceStats.maxDepth) {
+    ctx->workspaceStats.maxDepth = ctx->workspaceStats.tickDepth;
+  }
+  ctx->workspaceStats.bytesNotCleared += ctx->workspaceStats.tickBytes;
+  ctx->workspaceStats.tickBytes = 0;
+  ctx->workspaceStats.tickDepth = 0;
+  ctx->workspaceStats.ticks++;
+}
+
+//prints what the workspaces saved compared to every flood fill zeroing its own
+//visited map (and keeping its queue) on the stack
+void print_workspace_stats(AgentContext *ctx, FILE *out) {
+  workspace_tick(ctx);
+  long ticks = ctx->workspaceStats.ticks - 1;
+  long frame = (long)NUM_CELLS * (sizeof(unsigned int) + sizeof(Coords));
+  fprintf(out, "workspaces: %ld flood fills, %.0f bytes of memset saved per turn (max %ld)\n",
+    ctx->workspaceStats.acquired,
+    ticks ? (double)ctx->workspaceStats.bytesNotCleared / ticks : 0.0,
+    ctx->workspaceStats.maxTickBytes);
+  fprintf(out, "workspaces: stack high-water %ld bytes lower (%d nested flood fills)\n",
+    ctx->workspaceStats.maxDepth * frame, ctx->workspaceStats.maxDepth);
+}
+
+//The deadline. get_action() starts the clock and the long searches (the hop planner, the crossing front and
+//D* Lite) poll deadline_passed() as they go, stopping with what they have when it fires: the hop planner falls
+//back to choosing an island greedily, the crossing front keeps the crossings found so far and D* Lite leaves
+//its queue as it is and picks up from there next turn. If the cascade has nothing by then the turn ends on
+//safe_action().
+
+void deadline_start(AgentContext *ctx) {
+  clock_gettime(CLOCK_MONOTONIC, &ctx->deadline.start);
+  ctx->deadline.expired = false;
+  ctx->deadline.checks = 0;
+}
+
+//whether the turn is out of time. Once it is it stays that way until the next turn
+bool deadline_passed(AgentContext *ctx) {
+  if(ctx->deadline.expired) return true;
+  if(ctx->deadline.budgetMs <= 0 || ctx->deadline.checks++ % DEADLINE_CHECK_EVERY != 0) {
+    return false;
+  }
+  if(deadline_elapsed(ctx) < ctx->deadline.budgetMs) return false;
+  ctx->deadline.expired = true;
+  ctx->deadline.fired++;
+  return true;
+}
+
+//milliseconds since the turn started
+double deadline_elapsed(AgentContext *ctx) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - ctx->deadline.start.tv_sec) * 1e3 +
+    (now.tv_nsec - ctx->deadline.start.tv_nsec) / 1e6;
+}
+
+void deadline_end(AgentContext *ctx) {
+  double ms = deadline_elapsed(ctx);
+  if(ms > ctx->deadline.worstMs) ctx->deadline.worstMs = ms;
+  ctx->deadline.ticks++;
+}
+
+void print_deadline_stats(AgentContext *ctx, FILE *out) {
+  fprintf(out, "deadline: %d ms a turn, ran out on %ld of %ld turns (slowest %.2f ms)\n",
+    ctx->deadline.budgetMs, ctx->deadline.fired, ctx->deadline.ticks, ctx->deadline.worstMs);
+  fprintf(out, "deadline: %ld safe fallback actions, %ld unsafe actions vetoed\n",
+    ctx->deadline.fallbacks, ctx->deadline.vetoed);
+}
+
+//an action can only kill us by moving off the edge of the world or into water we can't cross
+bool action_is_safe(AgentContext *ctx, char action) {
+  if(action != 'f' && action != 'F') return true;
+  int forwardX, forwardY;
+  result_of_move(ctx->agent.location.x, ctx->agent.location.y,
+    ctx->agent.direction, &forwardX, &forwardY);
+  char ahead = wmap_at(ctx, forwardX, forwardY);
+  if(ahead == '.' || ahead == 0) return false;
+  return ahead != '~' || ctx->agent.stones > 0 || ctx->agent.raft || ctx->agent.currentlyRafting;
+}
+
+//something to do when there is no plan: keep going the way we face if it is somewhere we could plan
+//from (open land, or water while we are rafting), otherwise turn. It never uses up a stone or a raft
+char safe_action(AgentContext *ctx) {
+  ctx->deadline.fallbacks++;
+  int forwardX, forwardY;
+  result_of_move(ctx->agent.location.x, ctx->agent.location.y,
+    ctx->agent.direction, &forwardX, &forwardY);
+  char ahead = wmap_at(ctx, forwardX, forwardY);
+  if(ctx->agent.currentlyRafting ? ahead == '~' : !is_impassable(ctx, ahead)) return 'f';
+  return 'l';
+}
+
+//The speculative planner. Once an action has been sent main() has nothing to do until the engine sends the next
+//view, so a planner thread runs the decision cascade for the next turn in the meantime. update_agent() has already
+//moved the agent, and the only space we can be sure about is the one it is standing on, so that is marked visited
+//and everything else is planned from the map as it is. When the view arrives get_action() keeps the speculative
+//action if update_Wmap() changed no space (turning, or walking back over ground we have seen, which is most turns
+//late in the game). Otherwise the planned island hop and the plan cache go back to how they were and the turn is
+//planned again; the rest of what the cascade caches is kept up to date by update_Wmap() as usual.
+
+//wake the planner thread for the next turn
+void speculation_start(AgentContext *ctx) {
+  if(!ctx->speculation.started) {
+    pthread_mutex_init(&ctx->speculation.lock, NULL);
+    pthread_cond_init(&ctx->speculation.wake, NULL);
+    pthread_cond_init(&ctx->speculation.done, NULL);
+    if(pthread_create(&ctx->speculation.thread, NULL, speculation_thread, ctx) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+    ctx->speculation.started = true;
+  }
+  pthread_mutex_lock(&ctx->speculation.lock);
+  ctx->speculation.running = true;
+  ctx->speculation.ready = false;
+  pthread_cond_signal(&ctx->speculation.wake);
+  pthread_mutex_unlock(&ctx->speculation.lock);
+}
+
+//wait for the planner thread to be done with the world
+void speculation_wait(AgentContext *ctx) {
+  if(!ctx->speculation.started) return;
+  pthread_mutex_lock(&ctx->speculation.lock);
+  while(ctx->speculation.running) pthread_cond_wait(&ctx->speculation.done, &ctx->speculation.lock);
+  pthread_mutex_unlock(&ctx->speculation.lock);
+}
+
+//the planner thread of a context (arg), planning whenever it is woken
+void *speculation_thread(void *arg) {
+  AgentContext *ctx = arg;
+  while(true) {
+    pthread_mutex_lock(&ctx->speculation.lock);
+    while(!ctx->speculation.running && !ctx->speculation.stopping) {
+      pthread_cond_wait(&ctx->speculation.wake, &ctx->speculation.lock);
+    }
+    bool stopping = ctx->speculation.stopping;
+    pthread_mutex_unlock(&ctx->speculation.lock);
+    if(stopping) return NULL;
+    speculate(ctx);
+    pthread_mutex_lock(&ctx->speculation.lock);
+    ctx->speculation.running = false;
+    ctx->speculation.ready = true;
+    pthread_cond_signal(&ctx->speculation.done);
+    pthread_mutex_unlock(&ctx->speculation.lock);
+  }
+  return NULL;
+}
+
+//end the planner thread, if it was started, once it is done with the turn it is planning
+void speculation_stop(AgentContext *ctx) {
+  if(!ctx->speculation.started) return;
+  speculation_wait(ctx);
+  pthread_mutex_lock(&ctx->speculation.lock);
+  ctx->speculation.stopping = true;
+  pthread_cond_signal(&ctx->speculation.wake);
+  pthread_mutex_unlock(&ctx->speculation.lock);
+  pthread_join(ctx->speculation.thread, NULL);
+  pthread_mutex_destroy(&ctx->speculation.lock);
+  pthread_cond_destroy(&ctx->speculation.wake);
+  pthread_cond_destroy(&ctx->speculation.done);
+  ctx->speculation.started = false;
+}
+
+//plan the next turn from where update_agent() says we are
+void speculate(AgentContext *ctx) {
+  ctx->speculation.ic = ctx->ic;
+  ctx->speculation.goalTier = ctx->goalTier;
+  ctx->speculation.plan = ctx->plan;
+  if(ctx->plan.valid) {
+    memcpy(ctx->speculation.path, ctx->plan.states, (ctx->plan.length + 1) * sizeof(int));
+  }
+  ctx->speculation.runs++;
+  workspace_tick(ctx);
+  deadline_start(ctx);
+  changes_begin(ctx);
+  visit_space(ctx, ctx->agent.location.x, ctx->agent.location.y);
+  changes_apply(ctx);
+  ctx->speculation.action = plan_action(ctx);
+  //a turn cut short is better planned again with the real view
+  if(ctx->deadline.expired || !action_is_safe(ctx, ctx->speculation.action)) ctx->speculation.action = 0;
+}
+
+//whether the speculative action can be used this turn. If not, undo what the speculation
+//changed in the decisions carried between turns
+bool speculation_accepted(AgentContext *ctx) {
+  if(!ctx->speculation.ready) return false;
+  ctx->speculation.ready = false;
+  if(ctx->speculation.action != 0 && ctx->changeSet.count == 0) {
+    ctx->speculation.hits++;
+    return true;
+  }
+  ctx->speculation.misses++;
+  ctx->ic = ctx->speculation.ic;
+  ctx->goalTier = ctx->speculation.goalTier;
+  //only the plan's scalars are put back: the map store may have grown since, moving the arrays
+  PlanCache current = ctx->plan;
+  PlanCache old = ctx->speculation.plan;
+  ctx->plan = old;
+  ctx->plan.actions = current.actions;
+  ctx->plan.states = current.states;
+  ctx->plan.path = current.path;
+  ctx->plan.pathId = current.pathId;
+  ctx->plan.pathIndex = current.pathIndex;
+  ctx->plan.hits = current.hits;
+  ctx->plan.misses = current.misses;
+  //a plan stored since then has overwritten the old plan's path, so it is stored again from the copy
+  //speculate() kept (under a new id, as ids are never reused)
+  if(ctx->plan.id != current.id) {
+    ctx->plan.id = current.id;
+    if(old.valid) {
+      store_plan(ctx, ctx->speculation.path, old.length);
+      ctx->plan.tier = old.tier;
+      ctx->plan.next = old.next;
+    }
+  }
+  return false;
+}
+
+void print_speculation_stats(AgentContext *ctx, FILE *out) {
+  long total = ctx->speculation.hits + ctx->speculation.misses;
+  fprintf(out, "speculation: %ld of %ld turns used the plan made while waiting for the view (%.1f%%)\n",
+    ctx->speculation.hits, total, total ? 100.0 * ctx->speculation.hits / total : 0.0);
+}
+
+//Exploring by view. Heading for the nearest unseen space walks up to the edge of what we know one space at a
+//time, and in a maze that means a lot of doubling back. Instead every space the survey can step into within
+//VIEW_SLACK of the nearest unseen space is a place to stand, scored by how much unseen space the 5x5 view
+//would show from there over what it costs to get there. The view covers the same square whichever way we
+//face, so only the cost depends on the heading, and the survey already has the cheapest. The unseen spaces in
+//a square are counted a row at a time from the unseen bitplane.
+
+//the unseen spaces in a row of the map from x to x + width - 1. Spaces in tiles we haven't made are unseen
+int unseen_in_row(AgentContext *ctx, int x, int y, int width) {
+  int count = 0;
+  while(width > 0) {
+    int piece = TILE_SIZE - IN_TILE(x);
+    if(piece > width) piece = width;
+    int slot = find_tile(ctx, TILE_OF(x), TILE_OF(y));
+    if(slot == NO_TILE) count += piece;
+    else {
+      unsigned int row = PLANE_ROWS(slot, PLANE_UNSEEN)[IN_TILE(y)] >> IN_TILE(x);
+      if(piece < TILE_SIZE) row &= (1u << piece) - 1;
+      count += __builtin_popcount(row);
+    }
+    x += piece;
+    width -= piece;
+  }
+  return count;
+}
+
+//the unseen spaces the view would show standing on a space
+int view_gain(AgentContext *ctx, int x, int y) {
+  int gain = 0;
+  int dy;
+  for(dy = -POS_AGENT_IN_VIEW; dy <= POS_AGENT_IN_VIEW; dy++) {
+    gain += unseen_in_row(ctx, x - POS_AGENT_IN_VIEW, y + dy, 2 * POS_AGENT_IN_VIEW + 1);
+  }
+  return gain;
+}
+
+//the space to stand on that shows the most unseen space for the actions it costs to get there.
+//Returns false if there is no unseen space we can walk up to
+bool best_view(AgentContext *ctx, int *x, int *y) {
+  int nearestX, nearestY;
+  int nearest = survey_nearest(ctx, GOAL_UNSEEN, &nearestX, &nearestY);
+  if(nearest < 0) return false;
+  int horizon = nearest + VIEW_SLACK;
+  while(ctx->survey.settled + 1 < horizon && !queueEmpty(&ctx->survey.queue)) survey_step(ctx);
+  *x = nearestX;
+  *y = nearestY;
+  int bestGain = 0;
+  int bestCost = 1;
+  int i;
+  for(i = 0; i < ctx->survey.numEntered; i++) {
+    int cell = ctx->survey.entered[i];
+    int cost = ctx->survey.enterCost[cell];
+    if(cost > horizon || is_impassable(ctx, ctx->world.symbols[cell])) continue;
+    int gain = view_gain(ctx, cell_x(ctx, cell), cell_y(ctx, cell));
+    //gain / cost beats bestGain / bestCost, or ties it for fewer actions
+    if(gain * bestCost > bestGain * cost ||
+      (gain * bestCost == bestGain * cost && gain > 0 && cost < bestCost)) {
+      bestGain = gain;
+      bestCost = cost;
+      *x = cell_x(ctx, cell);
+      *y = cell_y(ctx, cell);
+    }
+  }
+  ctx->viewStats.searches++;
+  if(bestGain > 0) ctx->viewStats.gain += bestGain;
+  return true;
+}
+
+//check if a space is reachable from the agent's current location by land
+//i.e. it is next to a passable space we can walk to. Read from this turn's distance field
+int is_reachable(AgentContext *ctx, Coords agentLocation, int targetX, int targetY) {
+  assert(agentLocation.x == ctx->agent.location.x && agentLocation.y == ctx->agent.location.y);
+  return field_cost(ctx, targetX, targetY) >= 0;
+}
+
+//The frontier sets: the spaces exploring could still lead to. FRONTIER_UNSEEN holds the passable spaces next to
+//unseen space, FRONTIER_PERIMETER the passable spaces on the edge of an island we haven't stood on and
+//FRONTIER_WATER the water we haven't sailed over. A space can only join or leave a set when it
+//or a neighbour changes, so changes_apply() and visit_space() keep them up to date. A new key changes what is
+//passable, so they are built again then.
+//The nearest one by path is still found by the survey (or closest_reachable()), but the search only has to run
+//if one of them is on the island it searches: otherwise it would cover the whole island to find nothing.
+//Each set is a list of cells with slot (indexed by cell) holding a member's place in the list + 1, or 0.
+
+//is a space in a frontier set, going by the map as it is now
+bool frontier_belongs(AgentContext *ctx, int frontier, int cell) {
+  int x = cell_x(ctx, cell);
+  int y = cell_y(ctx, cell);
+  char space = ctx->world.symbols[cell];
+  switch(frontier) {
+    case FRONTIER_UNSEEN:
+      return !is_impassable(ctx, space) && adjacent_to(ctx, y, x, 0) != -1;
+    case FRONTIER_PERIMETER:
+      return !is_impassable(ctx, space) && ctx->world.been[cell] == 0 &&
+        adjacent_to_impassable(ctx, y, x) != -1;
+    //the same test closest_reachable() makes for UNSEEN_WATER, which (as adjacent_to() returns a direction)
+    //passes all the water we haven't sailed over but the spaces just below unseen space
+    default:
+      return space == '~' && ctx->world.been[cell] == 0 && adjacent_to(ctx, y, x, 0);
+  }
+}
+
+//add a space to or drop it from each set as it belongs
+void frontier_update(AgentContext *ctx, int cell) {
+  if(!ctx->frontiers.built || cell == NO_CELL) return;
+  ctx->frontiers.updates++;
+  int f;
+  for(f = 0; f < NUM_FRONTIERS; f++) {
+    FrontierSet *set = &ctx->frontiers.sets[f];
+    bool member = set->slot[cell] != 0;
+    if(member == frontier_belongs(ctx, f, cell)) continue;
+    if(!member) {
+      if(set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : TILE_CELLS;
+        set->members = realloc(set->members, set->capacity * sizeof(int));
+        assert(set->members != NULL);
+      }
+      set->members[set->count++] = cell;
+      set->slot[cell] = set->count;
+    } else {
+      //the last member takes its place
+      int last = set->members[--set->count];
+      set->members[set->slot[cell] - 1] = last;
+      set->slot[last] = set->slot[cell];
+      set->slot[cell] = 0;
+    }
+  }
+}
+
+//a space's symbol changed, which can move it and its neighbours in or out of the sets
+void frontier_space_changed(AgentContext *ctx, int x, int y) {
+  frontier_update(ctx, find_cell(ctx, x, y));
+  int dir;
+  for(dir = 0; dir < 4; dir++) {
+    int forwardX, forwardY;
+    result_of_move(x, y, dir, &forwardX, &forwardY);
+    frontier_update(ctx, find_cell(ctx, forwardX, forwardY));
+  }
+}
+
+//build the sets from scratch if they don't match the tools we have
+void frontiers_sync(AgentContext *ctx) {
+  if(ctx->frontiers.built && ctx->frontiers.key == ctx->agent.key) return;
+  int f;
+  for(f = 0; f < NUM_FRONTIERS; f++) {
+    memset(ctx->frontiers.sets[f].slot, 0, NUM_CELLS * sizeof(int));
+    ctx->frontiers.sets[f].count = 0;
+  }
+  ctx->frontiers.built = true;
+  ctx->frontiers.key = ctx->agent.key;
+  ctx->frontiers.rebuilds++;
+  int cell;
+  for(cell = 0; cell < ctx->world.numTiles * TILE_CELLS; cell++) frontier_update(ctx, cell);
+}
+
+//could a search from a space find a member of a frontier set. The water isn't split into islands,
+//so for FRONTIER_WATER any member will do
+bool frontier_open(AgentContext *ctx, int frontier, Coords from) {
+  frontiers_sync(ctx);
+  ctx->frontiers.queries++;
+  FrontierSet *set = &ctx->frontiers.sets[frontier];
+  if(frontier == FRONTIER_WATER) {
+    if(set->count > 0) return true;
+    ctx->frontiers.pruned++;
+    return false;
+  }
+  islands_sync(ctx);
+  int fromCell = find_cell(ctx, from.x, from.y);
+  int root = island_find(ctx, fromCell);
+  //not on an island (e.g. on a raft), so the sets can't rule anything out. The search also looks around
+  //the space it starts on even if it couldn't walk there (a stone or tree an island was first seen by)
+  if(root == NO_CELL ||
+    (frontier == FRONTIER_UNSEEN && adjacent_to(ctx, from.y, from.x, 0) != -1)) return true;
+  int i;
+  for(i = 0; i < set->count; i++) {
+    //a search never counts the space it starts on as the edge of the island
+    if(frontier == FRONTIER_PERIMETER && set->members[i] == fromCell) continue;
+    if(island_find(ctx, set->members[i]) == root) return true;
+  }
+  ctx->frontiers.pruned++;
+  return false;
+}
+
+int goal_frontier(int goal) {
+  switch(goal) {
+    case GOAL_UNSEEN:
+      return FRONTIER_UNSEEN;
+    case GOAL_PERIMETER:
+      return FRONTIER_PERIMETER;
+  }
+  return NO_FRONTIER;
+}
+
+int type_frontier(int type) {
+  switch(type) {
+    case UNSEEN:
+      return FRONTIER_UNSEEN;
+    case PERIMETER:
+      return FRONTIER_PERIMETER;
+    case UNSEEN_WATER:
+      return FRONTIER_WATER;
+  }
+  return NO_FRONTIER;
+}
+
+void frontier_grow(AgentContext *ctx, int oldCells, int newCells) {
+  int f;
+  for(f = 0; f < NUM_FRONTIERS; f++) {
+    ctx->frontiers.sets[f].slot = grow_array(ctx, ctx->frontiers.sets[f].slot, sizeof(int),
+      oldCells, newCells);
+  }
+}
+
+void print_frontier_stats(AgentContext *ctx, FILE *out) {
+  fprintf(out, "frontier sets: %d unseen, %d perimeter, %d water; %ld of %ld searches skipped (%ld updates, %ld rebuilds)\n",
+    ctx->frontiers.sets[FRONTIER_UNSEEN].count, ctx->frontiers.sets[FRONTIER_PERIMETER].count,
+    ctx->frontiers.sets[FRONTIER_WATER].count, ctx->frontiers.pruned, ctx->frontiers.queries,
+    ctx->frontiers.updates, ctx->frontiers.rebuilds);
+}
+
+//find the closest reachable space of a given type by land
+bool closest_reachable(AgentContext *ctx, Coords agentLocation, int *x,
+  int *y, int type) {
+
+  //the survey of this turn already knows the answer from where the agent is
+  if(agentLocation.x == ctx->agent.location.x && agentLocation.y == ctx->agent.location.y &&
+    type_goal(type) != NO_GOAL) {
+    return survey_nearest(ctx, type_goal(type), x, y) >= 0;
+  }
+  int frontier = type_frontier(type);
+  if(frontier != NO_FRONTIER && !frontier_open(ctx, frontier, agentLocation)) return false;
+
+  Workspace *ws = acquire_workspace(ctx);
+  ws->spaces[0].x = agentLocation.x;
+  ws->spaces[0].y = agentLocation.y;
+  mark_visited(ctx, ws, ws->spaces[0].x, ws->spaces[0].y);
   int closest_unseen = MAX_DIST;
   int dist = MAX_DIST;
 
@@ -1457,44 +3739,44 @@ bool closest_reachable(Coords agentLocation, int *x,
   //search radially outwards from the current space
   for(i = 0; i < counter; i++) {
     for(j = 0; j < 4; j++) {
-      int dir = (agent.direction + j) % 4; 
+      int dir = (ctx->agent.direction + j) % 4; 
       int forwardX, forwardY;
-      result_of_move(spaces[i].x, spaces[i].y, dir,
+      result_of_move(ws->spaces[i].x, ws->spaces[i].y, dir,
         &forwardX, &forwardY);
-      if(seen[forwardY][forwardX] == 1) continue;
+      if(was_visited(ctx, ws, forwardX, forwardY)) continue;
 
       bool case_switch = true;
 
       switch(type) {
         case UNSEEN:
-          if(Wmap[forwardY][forwardX] != 0) case_switch = false;
+          if(wmap_at(ctx, forwardX, forwardY) != 0) case_switch = false;
           break;
         case UNSEEN_WATER:
-          if(Wmap[forwardY][forwardX] != '~' ||
-            placesBeen[forwardY][forwardX] != 0 || 
-            !adjacent_to(forwardY, forwardX, 0)) {
+          if(wmap_at(ctx, forwardX, forwardY) != '~' ||
+            been_at(ctx, forwardX, forwardY) != 0 || 
+            !adjacent_to(ctx, forwardY, forwardX, 0)) {
               case_switch = false;
             }
           break;
 
         case PERIMETER:
-          if(is_impassable(Wmap[forwardY][forwardX]) ||
-            placesBeen[forwardY][forwardX] == 1) {
+          if(is_impassable(ctx, wmap_at(ctx, forwardX, forwardY)) ||
+            been_at(ctx, forwardX, forwardY) == 1) {
             case_switch = false;
           }
           break;
         default:
-          if(Wmap[forwardY][forwardX] != type) case_switch = false;
+          if(wmap_at(ctx, forwardX, forwardY) != type) case_switch = false;
       }
  
       if(case_switch == true) {
         if(type == PERIMETER &&
-          adjacent_to_impassable(forwardY, forwardX) == -1) continue;
+          adjacent_to_impassable(ctx, forwardY, forwardX) == -1) continue;
           //if the space found passes the requirements of its type and it is the closest one
           //that fulfil that types requirements then we save its coordinates to be returned
           //and later pathed to
         dist = adjusted_manhattan_dist(forwardX, forwardY,
-          agentLocation.x, agentLocation.y, agent.direction);
+          agentLocation.x, agentLocation.y, ctx->agent.direction);
         if(dist < closest_unseen) {
           closest_unseen = dist;
           *x = forwardX;
@@ -1503,10 +3785,10 @@ bool closest_reachable(Coords agentLocation, int *x,
       } else {
         switch(type) {
           case UNSEEN_WATER:
-            if(Wmap[forwardY][forwardX] == '~') case_switch = true;
+            if(wmap_at(ctx, forwardX, forwardY) == '~') case_switch = true;
             break;
           default:
-            if(is_impassable(Wmap[forwardY][forwardX]) == 0) {
+            if(is_impassable(ctx, wmap_at(ctx, forwardX, forwardY)) == 0) {
               case_switch = true;
             }
             break;
@@ -1514,9 +3796,9 @@ bool closest_reachable(Coords agentLocation, int *x,
         //otherwise as long as the space is passable (by land unless we are looking for water)
         //we add it to be searched from
         if(case_switch == true) {
-          spaces[counter].x = forwardX;
-          spaces[counter].y = forwardY;
-          seen[forwardY][forwardX] = 1;
+          ws->spaces[counter].x = forwardX;
+          ws->spaces[counter].y = forwardY;
+          mark_visited(ctx, ws, forwardX, forwardY);
           counter++;
         }
       }
@@ -1525,6 +3807,7 @@ bool closest_reachable(Coords agentLocation, int *x,
       
     if(closest_unseen != MAX_DIST) break;
   }
+  release_workspace(ctx, ws);
   if(closest_unseen == MAX_DIST) return false;
   return true;
 }
@@ -1547,12 +3830,12 @@ int adjusted_manhattan_dist(int x1, int y1, int x2, int y2, int dir) {
 }
 
 //checks if there is the given char in a space adjacent to a given space
-int adjacent_to(int yCoord, int xCoord, char target) { 
+int adjacent_to(AgentContext *ctx, int yCoord, int xCoord, char target) { 
   int dir;
   for(dir = 0; dir < 4; dir++) {
     int forwardX, forwardY;
     result_of_move(xCoord, yCoord, dir, &forwardX, &forwardY);
-    if(Wmap[forwardY][forwardX] == target) {
+    if(wmap_at(ctx, forwardX, forwardY) == target) {
       return dir;
     }
   }
@@ -1561,14 +3844,14 @@ int adjacent_to(int yCoord, int xCoord, char target) {
 
 //checks if any of the squares adjacent to a given square are impassable
 //used for determining a space on the perimeter of an island
-int adjacent_to_impassable(int yCoord, int xCoord) {
+int adjacent_to_impassable(AgentContext *ctx, int yCoord, int xCoord) {
   int dir;
   for(dir = 0; dir < 4; dir++) {
     int forwardX, forwardY;
     result_of_move(xCoord, yCoord, dir, &forwardX, &forwardY);
-    if(Wmap[forwardY][forwardX] != 'o' &&
-      Wmap[forwardY][forwardX] != 'T' && 
-      is_impassable(Wmap[forwardY][forwardX])) return dir;
+    if(wmap_at(ctx, forwardX, forwardY) != 'o' &&
+      wmap_at(ctx, forwardX, forwardY) != 'T' && 
+      is_impassable(ctx, wmap_at(ctx, forwardX, forwardY))) return dir;
   }
 
   return -1;
@@ -1595,32 +3878,25 @@ int out_of_bounds(int x, int y, int max) {
 
 //check if the space is passable
 //trees and stones are treated as impassable for normal traversal
-int is_impassable(char space) {
+int is_impassable(AgentContext *ctx, char space) {
   return space == '.' || space == '*' || space == '~' ||
   space == 'T' || space == 0 || space == 'o' ||
-  (space == '-' && !agent.key);
+  (space == '-' && !ctx->agent.key);
 }
 
 //adapted version of is_impassable() to consider stones and trees (if we have an axe)
 //as passable. We usually avoid pathing through stones and trees to make sure they are used
 //optimally for water travel but in some cases that limits our options needlessly. 
-int is_impassable_island_time(char space) {
+int is_impassable_island_time(AgentContext *ctx, char space) {
   return space == '.' || space == '*' || space == '~' ||
-  (space == 'T' && !agent.axe) || space == 0 ||
-  (space == '-' && !agent.key);
-}
-
-//resets a 2d array so all elements are 0
-void reset(int map[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]) {
-  int i,j;
-  for(i = 0; i < DOUBLE_MAX_MAP; i++) {
-    for(j = 0; j < DOUBLE_MAX_MAP; j++) {
-      map[i][j] = 0;
-    }
-  }
+  (space == 'T' && !ctx->agent.axe) || space == 0 ||
+  (space == '-' && !ctx->agent.key);
 }
 
-//check if two spaces are on the same island
-bool on_same_island(int x1, int y1, int x2, int y2) {
-  return islandMap[y1][x1] == islandMap[y2][x2];
+//check if two spaces are on the same island, as the island sets have it now
+//(the labels from the last create_islandMap() may be out of date)
+bool on_same_island(AgentContext *ctx, int x1, int y1, int x2, int y2) {
+  islands_sync(ctx);
+  int root = island_find(ctx, find_cell(ctx, x1, y1));
+  return root != NO_CELL && root == island_find(ctx, find_cell(ctx, x2, y2));
 }
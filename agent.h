@@ -3,14 +3,92 @@
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h> 
+#include <pthread.h>
+#include <time.h>
 
-#define AGENT_START 80
-#define MAX_MAP 80
-#define DOUBLE_MAX_MAP 160
+//the agent doesn't know where in the world it starts, so it calls its start a space far from 0 in both
+//directions. Coordinates then never go negative (-1 is used to mean no space throughout)
+#define AGENT_START (1 << 20)
 #define POS_AGENT_IN_VIEW 2
 #define NUM_TO_NEW_LANE 5
-#define MAX_DIST (DOUBLE_MAX_MAP * DOUBLE_MAX_MAP)
+#define MAX_DIST 0x3fffffff
 #define NUM_DIRECTIONS 4
+#define NUM_BUCKETS 102400
+#define INITIAL_POOL_SIZE 1024
+#define NO_NODE -1
+#define NO_STATE -1
+#define DSTAR_INF 0x3f3f3f3f
+#define NUM_WORKSPACES 4
+//planning threads besides the agent's own, and the fewest jobs worth handing to them
+#define NUM_WORKERS 3
+#define PARALLEL_MIN_JOBS 4
+#define INITIAL_ISLANDS 16
+#define NO_SET -1
+//the hop planner remembers the islands a trip has been to in a 64 bit mask, and gives up after MAX_HOP_LABELS
+#define MAX_HOP_ISLANDS 64
+#define MAX_HOP_LABELS 4096
+//how long one turn may take before the agent settles for a safe action (0 for no limit), how many
+//deadline_passed() calls share a look at the clock and how many times the decision cascade is tried
+#ifndef TICK_BUDGET_MS
+#define TICK_BUDGET_MS 100
+#endif
+#define DEADLINE_CHECK_EVERY 64
+#define MAX_PLANNING_PASSES 4
+
+//the world map is split into TILE_SIZE x TILE_SIZE tiles, allocated as they are needed
+#define TILE_SHIFT 5
+#define TILE_SIZE (1 << TILE_SHIFT)
+#define TILE_CELLS (TILE_SIZE * TILE_SIZE)
+#define INITIAL_TILES 16
+#define INITIAL_DIRECTORY_SIZE 64
+#define NO_TILE -1
+#define NO_CELL -1
+
+//a view changes at most its 25 spaces. How each one changed (CHANGE_ITEM can go with either of the others)
+#define MAX_CHANGES 25
+#define CHANGE_SEEN 1
+#define CHANGE_SYMBOL 2
+#define CHANGE_ITEM 4
+
+//the frontier sets (see agent.c)
+#define FRONTIER_UNSEEN 0
+#define FRONTIER_PERIMETER 1
+#define FRONTIER_WATER 2
+#define NUM_FRONTIERS 3
+#define NO_FRONTIER -1
+//how much further than the nearest unseen space exploring will look for a better view
+#define VIEW_SLACK 12
+//tile position of a coordinate and its place within that tile (rounding down for negative coordinates)
+#define TILE_OF(v) ((v) >> TILE_SHIFT)
+#define IN_TILE(v) ((v) & (TILE_SIZE - 1))
+//how many spaces (and search states) the per space arrays currently have room for
+#define NUM_CELLS (ctx->world.capacity * TILE_CELLS)
+#define NUM_STATES (NUM_CELLS * NUM_DIRECTIONS)
+
+//a search state is an allocated space on the world map plus the direction the agent is facing
+#define STATE(x, y, dir) (cell_index(ctx, x, y) * NUM_DIRECTIONS + (dir))
+#define STATE_CELL(state) ((state) / NUM_DIRECTIONS)
+#define STATE_X(state) cell_x(ctx, STATE_CELL(state))
+#define STATE_Y(state) cell_y(ctx, STATE_CELL(state))
+#define STATE_DIR(state) ((state) % NUM_DIRECTIONS)
+
+//each tile mirrors its symbols as bitplanes, one TILE_SIZE bit row per row of the tile
+//(bit i is the space i along from the tile's left edge)
+#define PLANE_OPEN 0
+#define PLANE_WATER 1
+#define PLANE_UNSEEN 2
+#define PLANE_TREE 3
+#define PLANE_STONE 4
+#define PLANE_DOOR 5
+#define NUM_PLANES 6
+#define NO_PLANE -1
+#define PLANE_ROWS(slot, plane) (ctx->world.planes + ((slot) * NUM_PLANES + (plane)) * TILE_SIZE)
+
+//which spaces a bitwise flood fill may spread through
+#define PASS_LAND 0
+#define PASS_ISLAND 1
+#define PASS_SEEN 2
+#define NUM_REGIONS 3
 
 #define UP 0
 #define RIGHT 1
@@ -32,9 +110,35 @@
 #define LAND 0
 #define WATER 1
 
-int   pipe_fd;
-FILE* in_stream;
-FILE* out_stream;
+//what a survey (see survey_nearest()) can find the nearest of
+#define GOAL_UNSEEN 0
+#define GOAL_PERIMETER 1
+#define GOAL_TREE 2
+#define GOAL_STONE 3
+#define GOAL_WATER 4
+#define GOAL_BLOCKING_TREE 5
+#define GOAL_BLOCKING_STONE 6
+#define GOAL_BLOCKING_WATER 7
+#define GOAL_HOME 8
+#define GOAL_GOLD 9
+#define GOAL_KEY 10
+#define GOAL_AXE 11
+#define NUM_GOALS 12
+#define NO_GOAL -1
+
+//the step of the decision cascade in get_action() that chose the current target
+#define TIER_WATER_EXPLORE 1
+#define TIER_COLLECT_ITEMS 2
+#define TIER_EXPLORE 3
+#define TIER_PERIMETER 4
+#define TIER_CLEAR_PATH 5
+#define TIER_ISLAND_HOP 6
+#define TIER_WATER_CROSSING 7
+#define TIER_BLOCKING 8
+
+extern int   pipe_fd;
+extern FILE* in_stream;
+extern FILE* out_stream;
 
 typedef struct _coords {
   int x;
@@ -50,6 +154,10 @@ typedef struct _island {
   bool axe;
   bool key;
   int stones;
+  //the shortest crossing from the current island (see plan_crossings()), -1 if there isn't one
+  int crossing;
+  Coords port;
+  Coords homePort;
 } Island;
 
 //stores the path agent will take to get to the chosen island
@@ -77,95 +185,652 @@ typedef struct _agent {
   Coords seenKey;
 } Agent;
 
-typedef struct _searchNode *Link;
-
-//nodes used for the priority stack for A* search and BFS
+//nodes used for the bucket queue
+//nodes live in the queue's pool and are linked by index rather than by pointer
 typedef struct _searchNode {
   int xPos;
   int yPos;
   int dir;
   int distFromStart;
   int heuristicCost;
-  Link next;
+  int next;
 } searchNode;
 
+//bucket priority queue (Dial's algorithm) used by the Pareto crossing search and the hop planner.
+//every priority is a small integer cost so each one gets its own bucket (a list of nodes)
+//and the next node is found by scanning forward from the lowest non-empty bucket.
+//nodes are recycled through a free list so a search never calls malloc per node.
+typedef struct QueueRep {
+  int bucket[NUM_BUCKETS];
+  int minBucket;
+  int maxBucket;
+  int size;
+  int freeNodes;
+  int nodesUsed;
+  int poolSize;
+  searchNode *pool;
+} QueueRep;
+
+typedef struct QueueRep *Queue;
+
+//a turn aware Dijkstra search by land from where the agent is this turn, only run as far as the
+//queries so far have needed (see survey_nearest()). It is also the turn's distance field:
+//cost and move (the action that reached a state) are indexed by state and only valid where stamp
+//matches epoch, enterCost and enterFrom (the state a space is cheapest to step into from) are indexed
+//by cell and only valid where enterStamp does, and entered lists the cells that have one. best, hit and from
+//are the cheapest space found so far for each goal and settled the cost of the last state expanded.
+//It keeps its own queue so other searches can run between queries
+typedef struct _survey {
+  bool valid;
+  unsigned int epoch;
+  unsigned int *stamp;
+  int *cost;
+  char *move;
+  unsigned int *enterStamp;
+  int *enterCost;
+  int *enterFrom;
+  int *entered;
+  int numEntered;
+  int start;
+  int settled;
+  int best[NUM_GOALS];
+  Coords hit[NUM_GOALS];
+  int from[NUM_GOALS];
+  QueueRep queue;
+  long runs;
+  long queries;
+  long expansions;
+  long routes;
+} Survey;
+
+//a label of the Pareto water crossing search: a way to reach a state using stones stones and actions actions
+typedef struct _paretoLabel {
+  int stones;
+  int actions;
+  int next;
+} ParetoLabel;
+
+//a crossing on the Pareto front, ending in the goal state
+typedef struct _crossingOption {
+  int stones;
+  int actions;
+  int goal;
+} CrossingOption;
+
+//the Pareto water crossing search (see crossing_front()). Each state keeps a list of the labels settled in it,
+//head (its first label in pool) is indexed by state and only valid where stamp matches epoch
+typedef struct _paretoSearch {
+  unsigned int epoch;
+  unsigned int *stamp;
+  int *head;
+  ParetoLabel *pool;
+  int poolSize;
+  int poolCapacity;
+  CrossingOption *front;
+  int frontSize;
+  int frontCapacity;
+  int start;
+  long runs;
+  long labels;
+} ParetoSearch;
+
+//sparse world map (see the map store in agent.c). symbols, islands, been and the
+//island sets' islandParent and islandSet are indexed by cell, tileOrigin and planes by tile slot.
+//id tells the stores of different contexts apart
+typedef struct _mapStore {
+  int numTiles;
+  int capacity;
+  Coords *tileOrigin;
+  int *directory;
+  int directorySize;
+  char *symbols;
+  int *islands;
+  char *been;
+  int *islandParent;
+  int *islandSet;
+  unsigned int *planes;
+  long bytes;
+  unsigned long id;
+} MapStore;
+
+//the spaces one view changed (see the change set in agent.c), what they were and how they changed
+typedef struct _changeSet {
+  int count;
+  Coords spaces[MAX_CHANGES];
+  char oldSymbols[MAX_CHANGES];
+  int kinds[MAX_CHANGES];
+  long ticks;
+  long emptyTicks;
+  long seen;
+  long changed;
+  long items;
+} ChangeSet;
+
+//a frontier set's members, and each cell's place among them + 1 (0 if it isn't one)
+typedef struct _frontierSet {
+  int *members;
+  int count;
+  int capacity;
+  int *slot;
+} FrontierSet;
+
+//key is what the sets were built with, pruned counts the searches they ruled out
+typedef struct _frontiers {
+  FrontierSet sets[NUM_FRONTIERS];
+  bool built;
+  bool key;
+  long updates;
+  long rebuilds;
+  long queries;
+  long pruned;
+} Frontiers;
+
+//how many places exploring by view has picked and the unseen spaces they were picked for
+typedef struct _viewStats {
+  long searches;
+  long gain;
+} ViewStats;
+
+//the most recent tile lookup, kept per thread so the thread pool's jobs can read the map,
+//and the id of the map store it was made in
+typedef struct _tileCache {
+  unsigned long store;
+  int tileX;
+  int tileY;
+  int slot;
+} TileCache;
+
+extern __thread TileCache tileCache;
+
+//one island of the island sets and how much of each item is on it.
+//number is its place in islandsInfo as of the last create_islandMap() (0 if it has none)
+typedef struct _islandSet {
+  bool live;
+  int root;
+  int size;
+  int gold;
+  int trees;
+  int axes;
+  int keys;
+  int stones;
+  bool returnSquare;
+  int number;
+  int nextFree;
+} IslandSet;
+
+//every space passable at island time, grouped into islands with a union-find that is kept up to
+//date as update_Wmap() sees spaces. world.islandParent holds each space's parent cell + 1 (0 if it isn't
+//on an island) and world.islandSet the set of a root. count sets are live out of the numSets used,
+//the rest are on the freeSets list. axe and key are the tools the sets were built with.
+//revision counts changes to the island map that can change the crossings between islands
+typedef struct _islandSets {
+  bool axe;
+  bool key;
+  bool stale;
+  int count;
+  int numSets;
+  int capacity;
+  int freeSets;
+  IslandSet *sets;
+  long unions;
+  long rebuilds;
+  long revision;
+} IslandSets;
 
-typedef struct StackRep {
-  Link  top;
-} StackRep;
+//the shortest crossing from one island to another: the water spaces crossed (the stones it would take)
+//and the ports it leaves from and lands on. reach counts the other islands the last stone put down
+//would leave next to it or one more stone away (see bridge_reach())
+typedef struct _crossingEdge {
+  int to;
+  int crossing;
+  int reach;
+  Coords port;
+  Coords homePort;
+} CrossingEdge;
 
-typedef struct StackRep *Stack;
+//the crossings out of one island, valid for the island map revision it was built in.
+//If walked they only leave from ports the agent could walk to from from
+typedef struct _crossingRow {
+  bool built;
+  long revision;
+  bool walked;
+  Coords from;
+  int numEdges;
+  int capacity;
+  CrossingEdge *edges;
+} CrossingRow;
 
-void update_agent(char action);
-void update_Wmap(char view[5][5]);
-void adjust_dir_vector(int *x, int *y);
+//a state of the hop planner (see plan_hops()): on island with what we are carrying, having spent the islands
+//in visited, for cost. The hop that got here went from homePort to port crossing water spaces (byRaft if it
+//needed the raft) from the label parent. nextAt links the labels settled on the same island
+typedef struct _hopLabel {
+  int island;
+  int stones;
+  bool raft;
+  bool axe;
+  bool key;
+  bool gold;
+  unsigned long long visited;
+  int cost;
+  Coords at;
+  int crossing;
+  bool byRaft;
+  Coords homePort;
+  Coords port;
+  int parent;
+  int nextAt;
+} HopLabel;
+
+//the hop planner's labels, the island set of each island number, the first label settled on each island
+//and the sets whose crossings are being built in parallel
+typedef struct _hopPlanner {
+  HopLabel *labels;
+  int numLabels;
+  int labelCapacity;
+  int *sets;
+  int *head;
+  int *jobs;
+  int capacity;
+  long runs;
+  long expansions;
+  long plans;
+} HopPlanner;
+
+//a row of crossings for each island set, plus one for when the agent isn't on an island
+typedef struct _crossingGraph {
+  int numRows;
+  CrossingRow *rows;
+  CrossingRow scratch;
+  long builds;
+  long reused;
+} CrossingGraph;
+
+//describes one search over the (x, y, direction) state lattice for a single target space
+typedef struct _searchSpec {
+  bool waterSearch;
+  bool islandTime;
+  int targetX;
+  int targetY;
+} SearchSpec;
+
+//an incremental D* Lite planner for one goal (spec). g is the cost to the goal found so far
+//and rhs the one step lookahead of it, states whose two disagree are queued in the heap.
+//Arrays are only valid where stamp matches generation
+typedef struct _dstar {
+  bool active;
+  SearchSpec spec;
+  bool key;
+  bool axe;
+  int generation;
+  int lastStart;
+  int km;
+  int heapSize;
+  long expansions;
+  long resets;
+  int *stamp;
+  int *g;
+  int *rhs;
+  int *key1;
+  int *key2;
+  int *heapPos;
+  int *heap;
+} DStar;
+
+//the full path found by the last search so later turns can replay it instead of searching again.
+//states[i] is where the agent should be before taking actions[i], pathIndex is the last
+//step of the path that passes through a space (only meaningful where pathId matches id).
+//pathId and pathIndex are indexed by cell, path is scratch space for building a plan
+typedef struct _planCache {
+  bool valid;
+  int id;
+  int tier;
+  int targetX;
+  int targetY;
+  bool waterSearch;
+  bool key;
+  bool axe;
+  int length;
+  int next;
+  char *actions;
+  int *states;
+  int *path;
+  int *pathId;
+  int *pathIndex;
+  long hits;
+  long misses;
+} PlanCache;
+
+//a set of spaces held as one bit row per tile row, for flood fills a whole row at a time.
+//Only tiles whose stamp matches epoch are in the set (listed in tiles), rows is indexed
+//by slot * TILE_SIZE + row
+typedef struct _bitRegion {
+  unsigned int epoch;
+  unsigned int *stamp;
+  unsigned int *rows;
+  int *tiles;
+  int numTiles;
+} BitRegion;
+
+//a port and what it costs to walk to from the agent, with its place in the order it was found
+//so that ports costing the same keep that order when sorted
+typedef struct _portCost {
+  Coords port;
+  int cost;
+  int found;
+} PortCost;
+
+//scratch space for one flood fill, reused between calls.
+//spaces is the fill's queue and stamp its visited map, both indexed by cell (see was_visited()).
+//from is for fills that need to remember where they reached each visited space from,
+//ports for sorting the ports a crossing starts from (see crossing_bfs()).
+//regions are for the bitwise flood fills (see region_step())
+typedef struct _workspace {
+  unsigned int epoch;
+  unsigned int *stamp;
+  Coords *spaces;
+  int *from;
+  PortCost *ports;
+  BitRegion regions[NUM_REGIONS];
+} Workspace;
+
+//a planning thread and the context it plans for
+typedef struct _poolWorker {
+  struct _agentContext *owner;
+  int id;
+} PoolWorker;
+
+//the planning threads (see the thread pool in agent.c). batch counts the batches handed out,
+//finished the jobs of the current one that are done. stopping tells the threads to exit,
+//serial that there are none (see agent_serial())
+typedef struct _threadPool {
+  bool started;
+  bool stopping;
+  bool serial;
+  pthread_t threads[NUM_WORKERS];
+  PoolWorker workers[NUM_WORKERS];
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  void (*job)(struct _agentContext *ctx, int job, Workspace *ws);
+  int numJobs;
+  int nextJob;
+  int finished;
+  long batch;
+  long batches;
+  long jobs;
+} ThreadPool;
+
+//how much clearing and stack the workspaces save. tickBytes/tickDepth cover the current turn
+typedef struct _workspaceStats {
+  long ticks;
+  long acquired;
+  long bytesNotCleared;
+  long tickBytes;
+  long maxTickBytes;
+  int tickDepth;
+  int maxDepth;
+} WorkspaceStats;
+
+//the current turn's deadline. fired counts the turns that ran out of time, fallbacks the turns
+//that ended on safe_action() and vetoed the planned actions that would have killed us
+typedef struct _deadline {
+  int budgetMs;
+  struct timespec start;
+  bool expired;
+  long checks;
+  long ticks;
+  long fired;
+  long fallbacks;
+  long vetoed;
+  double worstMs;
+} Deadline;
+
+//the planner thread's plan for the next turn (see the speculative planner in agent.c).
+//ic, goalTier and plan are what to put back if it isn't used (only plan's scalars, with path holding
+//the states of its path, indexed like PlanCache.states). stopping tells the thread to exit
+typedef struct _speculation {
+  bool started;
+  bool stopping;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  bool running;
+  bool ready;
+  char action;
+  IslandCrossing ic;
+  int goalTier;
+  PlanCache plan;
+  int *path;
+  long runs;
+  long hits;
+  long misses;
+} Speculation;
+
+//everything one agent knows and plans with (see the agent context in agent.c). The search queue is
+//the one the Pareto crossing search and the hop planner share (see newQueue())
+typedef struct _agentContext {
+  char view[5][5];
+  MapStore world;
+  Agent agent;
+  IslandCrossing ic;
+  Island *islandsInfo;
+  int islandsCapacity;
+  IslandSets islandSets;
+  CrossingGraph crossings;
+  PlanCache plan;
+  int goalTier;
+  DStar routePlanner;
+  Workspace workspaces[NUM_WORKSPACES + NUM_WORKERS];
+  int workspacesInUse;
+  WorkspaceStats workspaceStats;
+  Survey survey;
+  ParetoSearch pareto;
+  HopPlanner hops;
+  ThreadPool pool;
+  Deadline deadline;
+  Speculation speculation;
+  ChangeSet changeSet;
+  Frontiers frontiers;
+  ViewStats viewStats;
+  QueueRep searchQueue;
+  bool searchQueueInUse;
+} AgentContext;
+
+AgentContext *agent_new(void);
+char agent_step(AgentContext *ctx, char view[5][5]);
+void agent_serial(AgentContext *ctx);
+void agent_free(AgentContext *ctx);
+char get_action(AgentContext *ctx, char newView[5][5]);
+char plan_action(AgentContext *ctx);
+void update_agent(AgentContext *ctx, char action);
+void update_Wmap(AgentContext *ctx, char view[5][5]);
+void visit_space(AgentContext *ctx, int x, int y);
+void changes_begin(AgentContext *ctx);
+void change_space(AgentContext *ctx, int x, int y, char symbol);
+void changes_apply(AgentContext *ctx);
+bool frontier_belongs(AgentContext *ctx, int frontier, int cell);
+void frontier_update(AgentContext *ctx, int cell);
+void frontier_space_changed(AgentContext *ctx, int x, int y);
+void frontiers_sync(AgentContext *ctx);
+bool frontier_open(AgentContext *ctx, int frontier, Coords from);
+int goal_frontier(int goal);
+int type_frontier(int type);
+void frontier_grow(AgentContext *ctx, int oldCells, int newCells);
+void print_frontier_stats(AgentContext *ctx, FILE *out);
+int unseen_in_row(AgentContext *ctx, int x, int y, int width);
+int view_gain(AgentContext *ctx, int x, int y);
+bool best_view(AgentContext *ctx, int *x, int *y);
+void adjust_dir_vector(AgentContext *ctx, int *x, int *y);
 char choose_action(char view[5][5], char upAction, char downAction);
-int is_impassable(char space);
+int is_impassable(AgentContext *ctx, char space);
 int adjusted_manhattan_dist(int x1, int y1, int x2, int y2, int dir);
 void result_of_move(int xPos, int yPos, int dir,
   int *resultingX, int *resultingY);
-int adjacent_to_impassable(int yCoord, int xCoord);
-int create_islandMap(Coords agentLocation,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP],
-  Island islandsInfo[40]);
-bool find_island(Coords agentLocation,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP],
-  int *islandX, int *islandY);
-int adjacent_to(int yCoord, int xCoord, char target);
+int adjacent_to_impassable(AgentContext *ctx, int yCoord, int xCoord);
+int create_islandMap(AgentContext *ctx, Coords agentLocation);
+void island_number(AgentContext *ctx, Coords space, int *numIslands);
+int island_find(AgentContext *ctx, int cell);
+int island_root(AgentContext *ctx, int cell);
+int new_island_set(AgentContext *ctx, int cell);
+void island_join(AgentContext *ctx, int cell);
+void island_union(AgentContext *ctx, int a, int b);
+void island_count(IslandSet *set, char symbol, int sign);
+void islands_symbol_changed(AgentContext *ctx, int cell, char oldSymbol, char newSymbol);
+void islands_rebuild(AgentContext *ctx);
+void islands_sync(AgentContext *ctx);
+int adjacent_to(AgentContext *ctx, int yCoord, int xCoord, char target);
 int out_of_bounds(int x, int y, int max);
-int is_impassable_island_time(char space);
-void choose_island(int numIslands, Island islandsInfo[40],
-  IslandCrossing *ic, int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]);
-int path_to_best_port(int *bestTargetPortX, int *bestTargetPortY, 
+int is_impassable_island_time(AgentContext *ctx, char space);
+void choose_island(AgentContext *ctx, int numIslands, Island islandsInfo[],
+  IslandCrossing *ic);
+int path_to_best_port(AgentContext *ctx, int *bestTargetPortX, int *bestTargetPortY, 
   int *bestHomePortX, int *bestHomePortY, Coords startPos,
-  int stones, bool raft,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]);
-int find_blocking(Coords agentLocation, int *x, int *y,
-  char pickup);
+  int stones, bool raft);
+void plan_crossings(AgentContext *ctx, int numIslands);
+CrossingRow *agent_crossings(AgentContext *ctx);
+bool plan_hops(AgentContext *ctx, int numIslands, IslandCrossing *ic);
+void hop_sets(AgentContext *ctx, int numIslands);
+void hop_arrive(AgentContext *ctx, HopLabel *label);
+int hop_add(AgentContext *ctx, HopLabel *label);
+void hop_settle(AgentContext *ctx, int index);
+bool hop_dominated(AgentContext *ctx, HopLabel *label);
+CrossingRow *crossing_row(AgentContext *ctx, int set, bool walked);
+void build_crossing_row(AgentContext *ctx, CrossingRow *row, int set, bool walked);
+bool crossing_row_stale(AgentContext *ctx, CrossingRow *row, bool walked);
+void crossing_rows_grow(AgentContext *ctx);
+void prefetch_crossings(AgentContext *ctx, int numIslands);
+void prefetch_job(AgentContext *ctx, int job, Workspace *ws);
+void crossing_bfs(AgentContext *ctx, Workspace *ws, CrossingRow *row, int set, bool walked);
+int bridge_reach(AgentContext *ctx, int x, int y, int set, int to);
+void crossing_edge(AgentContext *ctx, CrossingRow *row, int to, int crossed, int reach, Coords port,
+  int homeCell);
+int closer_port(const void *a, const void *b);
+int find_blocking(AgentContext *ctx, int *x, int *y, char blocker);
 int adjacent_to_island_port(int yCoord, int xCoord,
   int portY, int portX);
-void reset(int map[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]);
-char search_setup(int targetX, int targetY, bool waterSearch);
-void Astar_search(Stack s, int targetX, int targetY,
-  int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP],
-  int costToReach[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP],
+char search_setup(AgentContext *ctx, int targetX, int targetY, bool waterSearch);
+bool is_search_goal(SearchSpec *spec, int x, int y);
+bool lattice_enterable(AgentContext *ctx, SearchSpec *spec, int x, int y);
+char store_plan(AgentContext *ctx, int path[], int length);
+void target_spec(AgentContext *ctx, SearchSpec *spec, int targetX, int targetY,
   bool waterSearch);
-char map_path(int predecessor[MAX_MAP * MAX_MAP], int currX, int currY);
-void pushOnto(Stack s, int xPos, int yPos, int dir,
+void space_changed(AgentContext *ctx, int x, int y);
+void survey_start(AgentContext *ctx);
+void survey_step(AgentContext *ctx);
+void survey_goals(AgentContext *ctx, int x, int y, int cost, int from);
+bool survey_matches(AgentContext *ctx, int goal, int x, int y);
+int survey_nearest(AgentContext *ctx, int goal, int *x, int *y);
+void survey_invalidate(AgentContext *ctx);
+int field_cost(AgentContext *ctx, int x, int y);
+char field_route(AgentContext *ctx, int x, int y);
+int field_parent(AgentContext *ctx, int state);
+void survey_grow(AgentContext *ctx, int oldCells, int newCells);
+int type_goal(int type);
+void plan_grow(AgentContext *ctx, int oldCells, int newCells);
+void dstar_grow(AgentContext *ctx, DStar *d, int oldCells, int newCells);
+void dstar_reset(AgentContext *ctx, DStar *d, SearchSpec *spec);
+int dstar_plan(AgentContext *ctx, DStar *d, SearchSpec *spec, int start);
+void dstar_space_changed(AgentContext *ctx, DStar *d, int x, int y);
+void dstar_update_space(AgentContext *ctx, DStar *d, int x, int y);
+int dstar_next_state(AgentContext *ctx, DStar *d, int state);
+char dstar_map_path(AgentContext *ctx, DStar *d, int start);
+int dstar_successor(AgentContext *ctx, DStar *d, int state, int i, int *cost);
+void dstar_update_vertex(AgentContext *ctx, DStar *d, int u);
+void dstar_update_predecessors(AgentContext *ctx, DStar *d, int u);
+void dstar_touch(DStar *d, int u);
+int dstar_g(DStar *d, int u);
+int dstar_rhs(DStar *d, int u);
+int dstar_heuristic(AgentContext *ctx, int from, int to);
+void dstar_key(AgentContext *ctx, DStar *d, int u, int key[2]);
+bool key_less(int a1, int a2, int b1, int b2);
+bool same_spec(SearchSpec *a, SearchSpec *b);
+void heap_set(AgentContext *ctx, DStar *d, int u, int key[2]);
+void heap_remove(DStar *d, int u);
+char replay_plan(AgentContext *ctx, int targetX, int targetY, bool waterSearch);
+void plan_space_changed(AgentContext *ctx, int x, int y);
+void print_plan_stats(AgentContext *ctx, FILE *out);
+long search_count(AgentContext *ctx);
+void pushOnto(Queue q, int xPos, int yPos, int dir,
   int distFromStart, int heuristicCost);
-void popFrom(Stack s, int *xPos, int *yPos, int *dir,
+void popFrom(Queue q, int *xPos, int *yPos, int *dir,
   int *distFromStart, int *heuristicCost);
-void disposeStack(Stack s);
-Stack newStack();
-static Link newNode(int xPos, int yPos, int dir,
-  int distFromStart, int heuristicCost);
-void disposeStack(Stack s);
-static void disposeNode(Link curr);
-int is_reachable(Coords agentLocation, int targetX, int targetY);
-bool closest_reachable(Coords agentLocation, int *x, int *y, int type);
-int non_return_island_check(int numIslands, IslandCrossing *ic,
-  Island islandsInfo[40],
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP], int type);
-int return_island_check(int numIslands, IslandCrossing *ic,
-  Island islandsInfo[40],
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP], int type);
-int stone_island_check(int numIslands, IslandCrossing *ic,
-  Island islandsInfo[40],
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]);
-char target_item(int targetX, int targetY);
-bool on_same_island(int x1, int y1, int x2, int y2);
-char collect_seen_items(void);
-char clear_path(void);
-char prepare_for_island_hop(void);
-char water_crossing(void);
-char cut_or_unlock(void);
-int plan_water_path(int islandPortX, int islandPortY, int dir, int *foundPortX,
-  int *foundPortY, int targetIsland, int stones, bool raft,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]);
-void count_stones(int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP],
-  int currX, int currY, int startingX, int startingY, int *stones);
-bool BFS_water_search(Stack s,
-  int costToReach[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP],
-  int predecessor[DOUBLE_MAX_MAP * DOUBLE_MAX_MAP],
-  int *foundPortX, int *foundPortY, int targetIsland,
-  int islandMap[DOUBLE_MAX_MAP][DOUBLE_MAX_MAP]);
+bool queueEmpty(Queue q);
+Queue newQueue(AgentContext *ctx);
+void disposeQueue(AgentContext *ctx, Queue q);
+void queue_reset(Queue q);
+void queue_empty_buckets(Queue q);
+unsigned int tile_hash(int tileX, int tileY, int size);
+int find_cell(AgentContext *ctx, int x, int y);
+int cell_index(AgentContext *ctx, int x, int y);
+int cell_x(AgentContext *ctx, int cell);
+int cell_y(AgentContext *ctx, int cell);
+char wmap_at(AgentContext *ctx, int x, int y);
+void set_wmap(AgentContext *ctx, int x, int y, char symbol);
+int island_at(AgentContext *ctx, int x, int y);
+void set_island(AgentContext *ctx, int x, int y, int island);
+int been_at(AgentContext *ctx, int x, int y);
+void set_been(AgentContext *ctx, int x, int y, int been);
+int symbol_plane(char symbol);
+void pass_rows(AgentContext *ctx, int slot, int mode, unsigned int mask[TILE_SIZE]);
+void region_clear(AgentContext *ctx, BitRegion *r);
+unsigned int *region_rows(BitRegion *r, int slot);
+unsigned int *region_peek(BitRegion *r, int slot);
+void region_add(AgentContext *ctx, BitRegion *r, int x, int y);
+int edge_rows(AgentContext *ctx, int slot, unsigned int rows[TILE_SIZE], int dir,
+  unsigned int edge[TILE_SIZE]);
+void region_step(AgentContext *ctx, BitRegion *frontier, BitRegion *discovered, BitRegion *next);
+bool region_mask(AgentContext *ctx, BitRegion *r, int mode);
+int region_spaces(AgentContext *ctx, BitRegion *r, int plane, Coords spaces[]);
+void region_grow(AgentContext *ctx, BitRegion *r, int oldTiles, int newTiles);
+void *grow_array(AgentContext *ctx, void *array, size_t size, int oldCount, int newCount);
+void grow_cell_arrays(AgentContext *ctx, int oldCells, int newCells);
+void print_map_stats(AgentContext *ctx, FILE *out);
+Workspace *acquire_workspace(AgentContext *ctx);
+void workspace_begin(AgentContext *ctx, Workspace *ws);
+void pool_run(AgentContext *ctx, int numJobs, void (*job)(AgentContext *ctx, int job, Workspace *ws));
+void pool_work(AgentContext *ctx, Workspace *ws);
+void *pool_worker(void *arg);
+void pool_stop(AgentContext *ctx);
+void release_workspace(AgentContext *ctx, Workspace *ws);
+bool was_visited(AgentContext *ctx, Workspace *ws, int x, int y);
+void mark_visited(AgentContext *ctx, Workspace *ws, int x, int y);
+void workspace_grow(AgentContext *ctx, int oldCells, int newCells);
+void workspace_tick(AgentContext *ctx);
+void print_workspace_stats(AgentContext *ctx, FILE *out);
+void deadline_start(AgentContext *ctx);
+bool deadline_passed(AgentContext *ctx);
+double deadline_elapsed(AgentContext *ctx);
+void deadline_end(AgentContext *ctx);
+void print_deadline_stats(AgentContext *ctx, FILE *out);
+bool action_is_safe(AgentContext *ctx, char action);
+char safe_action(AgentContext *ctx);
+void speculation_start(AgentContext *ctx);
+void speculation_wait(AgentContext *ctx);
+void *speculation_thread(void *arg);
+void speculation_stop(AgentContext *ctx);
+void speculate(AgentContext *ctx);
+bool speculation_accepted(AgentContext *ctx);
+void print_speculation_stats(AgentContext *ctx, FILE *out);
+int is_reachable(AgentContext *ctx, Coords agentLocation, int targetX, int targetY);
+bool closest_reachable(AgentContext *ctx, Coords agentLocation, int *x, int *y, int type);
+int non_return_island_check(AgentContext *ctx, int numIslands, IslandCrossing *ic,
+  Island islandsInfo[], int type);
+int return_island_check(AgentContext *ctx, int numIslands, IslandCrossing *ic,
+  Island islandsInfo[], int type);
+int stone_island_check(AgentContext *ctx, int numIslands, IslandCrossing *ic,
+  Island islandsInfo[]);
+char target_item(AgentContext *ctx, int goal);
+bool on_same_island(AgentContext *ctx, int x1, int y1, int x2, int y2);
+char collect_seen_items(AgentContext *ctx);
+char clear_path(AgentContext *ctx);
+char prepare_for_island_hop(AgentContext *ctx);
+char water_crossing(AgentContext *ctx);
+char cut_or_unlock(AgentContext *ctx);
+int crossing_front(AgentContext *ctx, int targetX, int targetY, int maxStones);
+void pareto_label(AgentContext *ctx, int state, int stones, int actions);
+void pareto_option(AgentContext *ctx, int goal, int stones, int actions);
+bool pareto_settled(AgentContext *ctx, int state, int stones, int actions);
+char crossing_route(AgentContext *ctx, CrossingOption *option);
+char cross_water(AgentContext *ctx, int targetX, int targetY);
+void pareto_grow(AgentContext *ctx, int oldCells, int newCells);
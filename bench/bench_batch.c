@@ -0,0 +1,292 @@
+//Batch game runner for tuning and regression runs over many generated maps. Plays games on maps made by
+//sim_generate_map() (one per seed, see game_spec() for what each gets) on every core in one process.
+//Each game gets its own agent context (see agent_new()) planning on the worker's thread alone (agent_serial()),
+//so the workers share nothing but the scheduler and the totals.
+//Games can take tens of moves or thousands, so handing them out in fixed shares would leave most cores idle at
+//the end. Instead each worker starts with an even share of the games as a range of game numbers and plays them
+//from the bottom; a worker that runs out steals the top half of the range of another that still has games left.
+//A range is packed into one 64 bit word, so taking a game and stealing are each a single compare and swap.
+//The totals are atomic counters added to as each game ends, and each game's own line is written to a slot
+//of its own, so no locks are taken at all.
+//Options:
+//  -g games    games to play (default 1000)
+//  -j threads  worker threads (default one per core)
+//  -n size     the largest map (default 80; each game gets a size between MIN_SIZE and this)
+//  -i islands  the most islands besides the agent's (default 4)
+//  -m maze     the most percent of maze walls kept (default 100)
+//  -M moves    moves a game gets before it is called off (default SIM_MAX_MOVES)
+//  -s seed     seed of the first game (default 1), the rest follow on from it
+//  -v          print a line per game too
+//
+//Build and run from the repository root:
+//  gcc -O2 -pthread -DAGENT_NO_MAIN -DSIM_NO_MAIN -o bench_batch bench/bench_batch.c sim.c agent.c
+//  for j in 1 2 4 8; do ./bench_batch -g 2000 -j $j; done
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "../agent.h"
+#include "../sim.h"
+
+#define MIN_SIZE 16
+#define MAX_THREADS 256
+//game lengths are counted in powers of 2 up to 2^(LENGTH_BUCKETS - 1) moves and more
+#define LENGTH_BUCKETS 16
+//how many lost games are listed with the command to make their map again
+#define MAX_LOST_SHOWN 10
+#define CACHE_LINE 64
+
+//the games a worker has left to play, lo to hi - 1, packed as lo << 32 | hi.
+//Padded to a cache line so a worker taking a game doesn't slow the others down
+typedef struct _gameRange {
+  _Atomic unsigned long long range;
+  char pad[CACHE_LINE - sizeof(unsigned long long)];
+} GameRange;
+
+//one game as it was played
+typedef struct _gameRecord {
+  unsigned int seed;
+  MapSpec spec;
+  int result;
+  int moves;
+  double ms;
+} GameRecord;
+
+//what every game adds to when it ends
+typedef struct _totals {
+  atomic_long played;
+  atomic_long results[SIM_MOVES_OUT + 1];
+  atomic_long moves;
+  atomic_long turnNs;
+  atomic_long worstTurnNs;
+  atomic_long searches;
+  atomic_long steals;
+  atomic_long lengths[LENGTH_BUCKETS];
+} Totals;
+
+static GameRange ranges[MAX_THREADS];
+static GameRecord *records;
+static Totals totals;
+static int numThreads;
+static int numGames;
+static int maxSize = 80;
+static int maxIslands = 4;
+static int maxMaze = 100;
+static int maxMoves = SIM_MAX_MOVES;
+static unsigned int firstSeed = 1;
+
+static unsigned long long pack_range(unsigned int lo, unsigned int hi) {
+  return (unsigned long long)lo << 32 | hi;
+}
+
+static unsigned int range_lo(unsigned long long range) {
+  return range >> 32;
+}
+
+static unsigned int range_hi(unsigned long long range) {
+  return range & 0xffffffffu;
+}
+
+//take the next game of a worker's own range. Returns -1 if it has none left
+static int take_own(int worker) {
+  unsigned long long range = atomic_load(&ranges[worker].range);
+  while(range_lo(range) < range_hi(range)) {
+    unsigned long long taken = pack_range(range_lo(range) + 1, range_hi(range));
+    if(atomic_compare_exchange_weak(&ranges[worker].range, &range, taken)) return range_lo(range);
+  }
+  return -1;
+}
+
+//steal the top half of the first range after a worker's own that has games left, keeping the rest of
+//the stolen games as its own range. Returns the game to play next, or -1 if every range is empty
+static int steal(int worker) {
+  int i;
+  for(i = 1; i < numThreads; i++) {
+    int victim = (worker + i) % numThreads;
+    unsigned long long range = atomic_load(&ranges[victim].range);
+    while(range_lo(range) < range_hi(range)) {
+      unsigned int lo = range_lo(range);
+      unsigned int hi = range_hi(range);
+      unsigned int mid = lo + (hi - lo) / 2;
+      if(atomic_compare_exchange_weak(&ranges[victim].range, &range, pack_range(lo, mid))) {
+        //the worker's own range is empty, so no one else is touching it
+        atomic_store(&ranges[worker].range, pack_range(mid + 1, hi));
+        atomic_fetch_add_explicit(&totals.steals, 1, memory_order_relaxed);
+        return mid;
+      }
+    }
+  }
+  return -1;
+}
+
+//a small random number generator of our own, so a game's map depends on its seed alone
+static unsigned int next_random(unsigned int *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return (*seed >> 16) & 0x7fff;
+}
+
+//what a game's map is made with: its size, islands and maze are drawn from the seed, up to the maxima asked
+//for, with the odd tree and door. Islands are dropped until they fit on the map
+static void game_spec(unsigned int seed, MapSpec *spec) {
+  unsigned int r = seed;
+  memset(spec, 0, sizeof(MapSpec));
+  spec->size = MIN_SIZE + next_random(&r) % (maxSize - MIN_SIZE + 1);
+  spec->islands = next_random(&r) % (maxIslands + 1);
+  spec->maze = next_random(&r) % (maxMaze + 1);
+  spec->trees = next_random(&r) % 3;
+  spec->doors = next_random(&r) % 3;
+  spec->gap = 1;
+  spec->solvable = true;
+}
+
+static void atomic_max(atomic_long *max, long value) {
+  long seen = atomic_load_explicit(max, memory_order_relaxed);
+  while(value > seen && !atomic_compare_exchange_weak(max, &seen, value));
+}
+
+static long ns_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
+}
+
+//play one game with a new agent and add it to the totals
+static void play(int number) {
+  GameRecord *record = &records[number];
+  Game game;
+  char view[5][5];
+  long turnNs = 0;
+  long worstNs = 0;
+
+  record->seed = firstSeed + number;
+  game_spec(record->seed, &record->spec);
+  while(!sim_generate_map(&game, &record->spec, record->seed)) record->spec.islands--;
+  AgentContext *agent = agent_new();
+  agent_serial(agent);
+  while(game.result == SIM_PLAYING && game.moves < maxMoves) {
+    struct timespec start;
+    sim_view(&game, view);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char action = agent_step(agent, view);
+    long ns = ns_since(&start);
+    turnNs += ns;
+    if(ns > worstNs) worstNs = ns;
+    sim_apply(&game, action);
+  }
+  if(game.result == SIM_PLAYING) game.result = SIM_MOVES_OUT;
+  record->result = game.result;
+  record->moves = game.moves;
+  record->ms = turnNs / 1e6;
+
+  int bucket = 0;
+  while(bucket < LENGTH_BUCKETS - 1 && game.moves >= 2 << bucket) bucket++;
+  atomic_fetch_add_explicit(&totals.played, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&totals.results[game.result], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&totals.moves, game.moves, memory_order_relaxed);
+  atomic_fetch_add_explicit(&totals.turnNs, turnNs, memory_order_relaxed);
+  atomic_fetch_add_explicit(&totals.searches, search_count(agent), memory_order_relaxed);
+  atomic_fetch_add_explicit(&totals.lengths[bucket], 1, memory_order_relaxed);
+  atomic_max(&totals.worstTurnNs, worstNs);
+  agent_free(agent);
+  sim_free(&game);
+}
+
+static void *worker(void *arg) {
+  int id = *(int *)arg;
+  while(true) {
+    int number = take_own(id);
+    if(number == -1) number = steal(id);
+    if(number == -1) return NULL;
+    play(number);
+  }
+  return NULL;
+}
+
+static void print_record(GameRecord *r) {
+  printf("%u\t%d\t%d\t%d\t%s\t%d\t%.1f\n", r->seed, r->spec.size, r->spec.islands, r->spec.maze,
+    sim_result_name(r->result), r->moves, r->ms);
+}
+
+int main(int argc, char *argv[]) {
+  static pthread_t threads[MAX_THREADS];
+  static int ids[MAX_THREADS];
+  bool verbose = false;
+  int option;
+  int i;
+
+  numGames = 1000;
+  numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  while((option = getopt(argc, argv, "g:j:n:i:m:M:s:v")) != -1) {
+    switch(option) {
+      case 'g': numGames = atoi(optarg); break;
+      case 'j': numThreads = atoi(optarg); break;
+      case 'n': maxSize = atoi(optarg); break;
+      case 'i': maxIslands = atoi(optarg); break;
+      case 'm': maxMaze = atoi(optarg); break;
+      case 'M': maxMoves = atoi(optarg); break;
+      case 's': firstSeed = strtoul(optarg, NULL, 10); break;
+      case 'v': verbose = true; break;
+      default: optind = argc + 1;
+    }
+  }
+  if(optind != argc || numGames < 1 || numThreads < 1 || numThreads > MAX_THREADS ||
+    maxSize < MIN_SIZE || maxIslands < 0 || maxMaze < 0 || maxMoves < 1) {
+    fprintf(stderr, "Usage: %s [-g games] [-j threads] [-n size] [-i islands] [-m maze%%] "
+      "[-M moves] [-s seed] [-v]\n", argv[0]);
+    return 1;
+  }
+  records = calloc(numGames, sizeof(GameRecord));
+  assert(records != NULL);
+  for(i = 0; i < numThreads; i++) {
+    atomic_init(&ranges[i].range, pack_range((long)numGames * i / numThreads,
+      (long)numGames * (i + 1) / numThreads));
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < numThreads; i++) {
+    ids[i] = i;
+    if(pthread_create(&threads[i], NULL, worker, &ids[i]) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  for(i = 0; i < numThreads; i++) pthread_join(threads[i], NULL);
+  double seconds = ns_since(&start) / 1e9;
+
+  if(verbose) {
+    printf("#seed\tsize\tislands\tmaze\tresult\tmoves\tms\n");
+    for(i = 0; i < numGames; i++) print_record(&records[i]);
+  }
+  long played = totals.played;
+  long moves = totals.moves;
+  printf("%ld games on %d threads in %.2fs: %.1f games/s, %.0f moves/s, %ld steals\n", played, numThreads,
+    seconds, played / seconds, moves / seconds, (long)totals.steals);
+  for(i = SIM_WON; i <= SIM_MOVES_OUT; i++) {
+    printf("  %-9s %ld\n", sim_result_name(i), (long)totals.results[i]);
+  }
+  printf("moves: %ld in all, %.1f a game; %.1fus a turn, worst %.2fms; %.2f searches a turn\n", moves,
+    (double)moves / played, moves ? totals.turnNs / 1e3 / moves : 0.0, totals.worstTurnNs / 1e6,
+    moves ? (double)totals.searches / moves : 0.0);
+  printf("game lengths:\n");
+  for(i = 0; i < LENGTH_BUCKETS; i++) {
+    if(totals.lengths[i] == 0) continue;
+    printf("  %6d+ moves %6ld\n", i ? 1 << i : 0, (long)totals.lengths[i]);
+  }
+  //enough to make the map of a lost game again with bench/gen_map.c
+  int shown = 0;
+  for(i = 0; i < numGames && shown < MAX_LOST_SHOWN; i++) {
+    GameRecord *r = &records[i];
+    if(r->result == SIM_WON) continue;
+    if(shown++ == 0) printf("lost games:\n");
+    printf("  %-9s ./gen_map -n %d -i %d -m %d -t %d -d %d -s %u\n", sim_result_name(r->result),
+      r->spec.size, r->spec.islands, r->spec.maze, r->spec.trees, r->spec.doors, r->seed);
+  }
+  free(records);
+  return 0;
+}
@@ -0,0 +1,231 @@
+//End to end benchmark. Plays every map given on the command line, then GENERATED_WORLDS generated worlds
+//(see sim_generate()), through the engine in sim.c and records for each game how it ended, the moves it took,
+//the time get_action() took per turn (p50, p99 and worst), the searches started per turn (see search_count())
+//and the peak memory of the process that played it.
+//The results are printed as tab separated lines, one per game, so they can be kept as a baseline and diffed.
+//Given a baseline with -b, a game that is lost where it was won, takes more than MOVE_SLACK more moves
+//or has a p99 turn more than LATENCY_SLACK (and LATENCY_FLOOR_US) slower is reported on stderr
+//and the benchmark exits with 1. So is a game the baseline has no row for, so a run can't pass by
+//matching nothing. Maps are matched on their file name alone, wherever they are given from.
+//Each game is played by a new agent context in its own process, so the peak memory is the game's alone.
+//
+//Build and run from the repository root:
+//  gcc -O2 -pthread -DAGENT_NO_MAIN -DSIM_NO_MAIN -o bench_e2e bench/bench_e2e.c sim.c agent.c
+//  ./bench_e2e -b bench/baseline.tsv tests/*.in
+//  ./bench_e2e tests/*.in > bench/baseline.tsv   (to record a new baseline)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../agent.h"
+#include "../sim.h"
+
+#define GENERATED_WORLDS 4
+#define GENERATED_SIZE 120
+#define MAX_MOVES 30000
+#define MAX_NAME 64
+#define MAX_BASELINE 256
+//how much worse than the baseline a game may get before it counts as a regression
+#define MOVE_SLACK 0.05
+#define LATENCY_SLACK 0.5
+#define LATENCY_FLOOR_US 500
+
+//what one game is reported as
+typedef struct _record {
+  char name[MAX_NAME];
+  int result;
+  int moves;
+  double p50;
+  double p99;
+  double worst;
+  double searches;
+  long peakKb;
+} Record;
+
+static Record baseline[MAX_BASELINE];
+static int numBaseline = 0;
+
+static double us_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e6 +
+    (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int compare_times(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+//play a game to the end with a new agent, timing every turn
+static void play(Game *game, Record *record) {
+  double *times = malloc(MAX_MOVES * sizeof(double));
+  assert(times != NULL);
+  char view[5][5];
+  AgentContext *agent = agent_new();
+  while(game->result == SIM_PLAYING && game->moves < MAX_MOVES) {
+    struct timespec start;
+    sim_view(game, view);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char action = agent_step(agent, view);
+    times[game->moves] = us_since(&start);
+    sim_apply(game, action);
+  }
+  if(game->result == SIM_PLAYING) game->result = SIM_MOVES_OUT;
+  int moves = game->moves;
+  qsort(times, moves, sizeof(double), compare_times);
+  record->result = game->result;
+  record->moves = moves;
+  record->p50 = moves ? times[moves / 2] : 0;
+  record->p99 = moves ? times[(moves - 1) * 99 / 100] : 0;
+  record->worst = moves ? times[moves - 1] : 0;
+  record->searches = moves ? (double)search_count(agent) / moves : 0;
+  agent_free(agent);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  record->peakKb = usage.ru_maxrss;
+  free(times);
+}
+
+//play a map file (or a generated world if path is NULL) in a child process, which hands back its record
+static bool run(const char *path, unsigned int seed, Record *record) {
+  int fds[2];
+  assert(pipe(fds) == 0);
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if(pid == 0) {
+    Game game;
+    close(fds[0]);
+    if(path != NULL) {
+      snprintf(record->name, MAX_NAME, "%s", path);
+      if(!sim_load(&game, path)) _exit(2);
+    } else {
+      snprintf(record->name, MAX_NAME, "generated-%d-%u", GENERATED_SIZE, seed);
+      sim_generate(&game, GENERATED_SIZE, seed);
+    }
+    play(&game, record);
+    bool written = write(fds[1], record, sizeof(Record)) == sizeof(Record);
+    _exit(written ? 0 : 1);
+  }
+  close(fds[1]);
+  bool readBack = read(fds[0], record, sizeof(Record)) == sizeof(Record);
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return readBack && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int result_from_name(const char *name) {
+  int result;
+  for(result = SIM_PLAYING; result <= SIM_MOVES_OUT; result++) {
+    if(strcmp(name, sim_result_name(result)) == 0) return result;
+  }
+  return SIM_MOVES_OUT;
+}
+
+static void print_record(Record *r) {
+  printf("%s\t%s\t%d\t%.1f\t%.1f\t%.1f\t%.2f\t%ld\n", r->name, sim_result_name(r->result),
+    r->moves, r->p50, r->p99, r->worst, r->searches, r->peakKb);
+  fflush(stdout);
+}
+
+//read a baseline written by an earlier run. Returns false if the file can't be read
+static bool load_baseline(const char *path) {
+  FILE *f = fopen(path, "r");
+  if(f == NULL) return false;
+  char line[256];
+  while(numBaseline < MAX_BASELINE && fgets(line, sizeof(line), f)) {
+    Record *r = &baseline[numBaseline];
+    char result[MAX_NAME];
+    if(line[0] == '#') continue;
+    if(sscanf(line, "%63[^\t]\t%63[^\t]\t%d\t%lf\t%lf\t%lf\t%lf\t%ld", r->name, result,
+      &r->moves, &r->p50, &r->p99, &r->worst, &r->searches, &r->peakKb) != 8) continue;
+    r->result = result_from_name(result);
+    numBaseline++;
+  }
+  fclose(f);
+  return true;
+}
+
+//a game's name without the directory it was given from
+static const char *base_name(const char *name) {
+  const char *slash = strrchr(name, '/');
+  return slash != NULL ? slash + 1 : name;
+}
+
+//the baseline's row for a game, or NULL if it has none
+static Record *find_baseline(Record *r) {
+  int i;
+  for(i = 0; i < numBaseline; i++) {
+    if(strcmp(base_name(baseline[i].name), base_name(r->name)) == 0) return &baseline[i];
+  }
+  return NULL;
+}
+
+//compare a game with its baseline. Returns whether it regressed (or has nothing to compare with)
+static bool regressed(Record *r) {
+  Record *base = find_baseline(r);
+  if(base == NULL) {
+    fprintf(stderr, "%s: not in the baseline\n", r->name);
+    return true;
+  }
+  bool worse = false;
+  if(base->result == SIM_WON && r->result != SIM_WON) {
+    fprintf(stderr, "%s: %s, was won in %d moves\n", r->name, sim_result_name(r->result), base->moves);
+    worse = true;
+  } else if(base->result == SIM_WON && r->moves > base->moves * (1 + MOVE_SLACK)) {
+    fprintf(stderr, "%s: %d moves, was %d\n", r->name, r->moves, base->moves);
+    worse = true;
+  }
+  if(r->p99 > base->p99 * (1 + LATENCY_SLACK) && r->p99 - base->p99 > LATENCY_FLOOR_US) {
+    fprintf(stderr, "%s: p99 turn %.1fus, was %.1fus\n", r->name, r->p99, base->p99);
+    worse = true;
+  }
+  return worse;
+}
+
+int main(int argc, char *argv[]) {
+  int arg = 1;
+  int regressions = 0;
+  int failed = 0;
+  bool compare = false;
+  int i;
+
+  if(arg + 1 < argc && strcmp(argv[arg], "-b") == 0) {
+    if(!load_baseline(argv[arg + 1])) {
+      printf("could not read %s\n", argv[arg + 1]);
+      return 1;
+    }
+    compare = true;
+    arg += 2;
+  }
+  if(arg < argc && argv[arg][0] == '-') {
+    printf("Usage: %s [-b baseline.tsv] map.in ...\n", argv[0]);
+    return 1;
+  }
+  int numMaps = argc - arg;
+  printf("#map\tresult\tmoves\tp50_us\tp99_us\tmax_us\tsearches_per_turn\tpeak_kb\n");
+  for(i = 0; i < numMaps + GENERATED_WORLDS; i++) {
+    Record record;
+    memset(&record, 0, sizeof(record));
+    bool played = i < numMaps ? run(argv[arg + i], 0, &record) :
+      run(NULL, 1 + i - numMaps, &record);
+    if(!played) {
+      fprintf(stderr, "%s: could not be played\n", i < numMaps ? argv[arg + i] : "generated world");
+      failed++;
+      continue;
+    }
+    print_record(&record);
+    if(compare && regressed(&record)) regressions++;
+  }
+  if(compare) {
+    fprintf(stderr, "%d regressions against the baseline\n", regressions);
+  }
+  return regressions > 0 || failed > 0;
+}
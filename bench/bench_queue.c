@@ -0,0 +1,251 @@
+//Microbenchmark for the search queue.
+//Runs a turn-aware A* (costs 1/2/3 for straight/side/behind as in dstar_successor(), with the
+//adjusted_manhattan_dist() heuristic) between random pairs of open spaces using the old sorted linked list "priority stack"
+//and the bucket queue in agent.c, and reports the time taken by each.
+//Every map is run as is and tiled out to a GRID_SIZE x GRID_SIZE open plan map (the old fixed world size).
+//
+//Build and run from the repository root:
+//  gcc -O2 -pthread -DAGENT_NO_MAIN -o bench_queue bench/bench_queue.c agent.c
+//  ./bench_queue tests/*.in
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "../agent.h"
+
+#define SEARCHES_PER_MAP 200
+#define GRID_SIZE 160
+
+typedef struct _legacyNode *LegacyLink;
+
+typedef struct _legacyNode {
+  int xPos;
+  int yPos;
+  int dir;
+  int distFromStart;
+  int heuristicCost;
+  LegacyLink next;
+} legacyNode;
+
+typedef struct _legacyStack {
+  LegacyLink top;
+} legacyStack;
+
+static char grid[GRID_SIZE][GRID_SIZE];
+static int gridWidth, gridHeight;
+static int costToReach[GRID_SIZE][GRID_SIZE];
+
+//the old priority stack: sorted insertion into a linked list, malloc per node
+static void legacy_push(void *stack, int xPos, int yPos, int dir,
+  int distFromStart, int heuristicCost) {
+
+  legacyStack *s = stack;
+  LegacyLink new = malloc(sizeof(legacyNode));
+  assert(new != NULL);
+  new->xPos = xPos;
+  new->yPos = yPos;
+  new->dir = dir;
+  new->distFromStart = distFromStart;
+  new->heuristicCost = heuristicCost;
+  new->next = NULL;
+  LegacyLink curr = s->top;
+  if(curr == NULL) {
+    s->top = new;
+    return;
+  } else if(curr->next == NULL) {
+    if(heuristicCost < s->top->heuristicCost) {
+      new->next = s->top;
+      s->top = new;
+    } else s->top->next = new;
+    return;
+  }
+  while(curr->next != NULL &&
+    curr->next->heuristicCost < heuristicCost) {
+    curr = curr->next;
+  }
+  new->next = curr->next;
+  curr->next = new;
+}
+
+static void legacy_pop(void *stack, int *xPos, int *yPos, int *dir,
+  int *distFromStart, int *heuristicCost) {
+
+  legacyStack *s = stack;
+  LegacyLink old = s->top;
+  *xPos = old->xPos;
+  *yPos = old->yPos;
+  *dir = old->dir;
+  *distFromStart = old->distFromStart;
+  *heuristicCost = old->heuristicCost;
+  s->top = old->next;
+  free(old);
+}
+
+static bool legacy_empty(void *stack) {
+  return ((legacyStack *)stack)->top == NULL;
+}
+
+static void legacy_dispose(void *stack) {
+  legacyStack *s = stack;
+  while(s->top != NULL) {
+    LegacyLink next = s->top->next;
+    free(s->top);
+    s->top = next;
+  }
+}
+
+static void bucket_push(void *q, int xPos, int yPos, int dir,
+  int distFromStart, int heuristicCost) {
+  pushOnto(q, xPos, yPos, dir, distFromStart, heuristicCost);
+}
+
+static void bucket_pop(void *q, int *xPos, int *yPos, int *dir,
+  int *distFromStart, int *heuristicCost) {
+  popFrom(q, xPos, yPos, dir, distFromStart, heuristicCost);
+}
+
+static bool bucket_empty(void *q) {
+  return queueEmpty(q);
+}
+
+typedef struct _queueOps {
+  const char *name;
+  void (*push)(void *, int, int, int, int, int);
+  void (*pop)(void *, int *, int *, int *, int *, int *);
+  bool (*empty)(void *);
+} QueueOps;
+
+static bool blocked(int x, int y) {
+  if(out_of_bounds(x, y, GRID_SIZE) || x >= gridWidth ||
+    y >= gridHeight) return true;
+  return grid[y][x] == '*' || grid[y][x] == 'T' || grid[y][x] == '-';
+}
+
+//turn-aware A* from (startX, startY) facing UP, returns the cost to reach the target or -1
+static int search(QueueOps *ops, void *q, int startX, int startY,
+  int targetX, int targetY) {
+
+  int x, y, dir, dist, h;
+  memset(costToReach, 0, sizeof(costToReach));
+  costToReach[startY][startX] = -1;
+  ops->push(q, startX, startY, UP, 0,
+    adjusted_manhattan_dist(targetX, targetY, startX, startY, UP));
+  while(!ops->empty(q)) {
+    ops->pop(q, &x, &y, &dir, &dist, &h);
+    int i;
+    for(i = 0; i < NUM_DIRECTIONS; i++) {
+      int newDir = (dir + i) % 4;
+      int newX, newY, newDist;
+      result_of_move(x, y, newDir, &newX, &newY);
+      if(i == DOWN && !(x == startX && y == startY)) continue;
+      newDist = dist + (i == UP ? 1 : (i == DOWN ? 3 : 2));
+      if(blocked(newX, newY)) continue;
+      if(costToReach[newY][newX] == 0 || costToReach[newY][newX] > newDist) {
+        costToReach[newY][newX] = newDist;
+        if(newX == targetX && newY == targetY) return newDist;
+        ops->push(q, newX, newY, newDir, newDist, newDist +
+          adjusted_manhattan_dist(targetX, targetY, newX, newY, newDir));
+      }
+    }
+  }
+  return -1;
+}
+
+static bool load_map(const char *path, bool tile) {
+  char lines[GRID_SIZE][GRID_SIZE + 2];
+  int rows = 0, cols = 0;
+  FILE *f = fopen(path, "r");
+  if(f == NULL) return false;
+  while(rows < GRID_SIZE && fgets(lines[rows], sizeof(lines[rows]), f)) {
+    lines[rows][strcspn(lines[rows], "\r\n")] = '\0';
+    int len = strlen(lines[rows]);
+    if(len > cols) cols = len;
+    rows++;
+  }
+  fclose(f);
+  if(rows == 0) return false;
+  gridWidth = tile ? GRID_SIZE : cols;
+  gridHeight = tile ? GRID_SIZE : rows;
+  int x, y;
+  for(y = 0; y < gridHeight; y++) {
+    for(x = 0; x < gridWidth; x++) {
+      char *line = lines[y % rows];
+      grid[y][x] = (x % cols) < (int)strlen(line) ? line[x % cols] : ' ';
+    }
+  }
+  return true;
+}
+
+static double run(QueueOps *ops, void *q, void (*dispose)(void *),
+  int pairs[][4], int numPairs, long *totalCost) {
+
+  struct timespec start, end;
+  int i;
+  *totalCost = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < numPairs; i++) {
+    *totalCost += search(ops, q, pairs[i][0], pairs[i][1],
+      pairs[i][2], pairs[i][3]);
+    dispose(q);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) * 1e3 +
+    (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+//the bucket queue is an agent context's
+static AgentContext *agent;
+static Queue bucketQueue;
+
+static void bucket_reset(void *q) {
+  disposeQueue(agent, q);
+  bucketQueue = newQueue(agent);
+}
+
+int main(int argc, char *argv[]) {
+  QueueOps legacyOps = {"sorted list", legacy_push, legacy_pop, legacy_empty};
+  QueueOps bucketOps = {"bucket queue", bucket_push, bucket_pop, bucket_empty};
+  static int pairs[SEARCHES_PER_MAP][4];
+  int arg, tile;
+
+  if(argc < 2) {
+    printf("Usage: %s map.in ...\n", argv[0]);
+    return 1;
+  }
+  srand(3411);
+  agent = agent_new();
+  bucketQueue = newQueue(agent);
+  printf("%-20s %-6s %12s %12s %8s\n", "map", "size", "list ms",
+    "bucket ms", "speedup");
+  for(arg = 1; arg < argc; arg++) {
+    for(tile = 0; tile <= 1; tile++) {
+      if(!load_map(argv[arg], tile)) {
+        printf("could not read %s\n", argv[arg]);
+        return 1;
+      }
+      //random pairs of open spaces
+      int numPairs = 0;
+      while(numPairs < SEARCHES_PER_MAP) {
+        int p[4] = {rand() % gridWidth, rand() % gridHeight,
+          rand() % gridWidth, rand() % gridHeight};
+        if(blocked(p[0], p[1]) || blocked(p[2], p[3])) continue;
+        memcpy(pairs[numPairs++], p, sizeof(p));
+      }
+      legacyStack s = {NULL};
+      long legacyCost, bucketCost;
+      double legacyMs = run(&legacyOps, &s, legacy_dispose, pairs,
+        numPairs, &legacyCost);
+      double bucketMs = run(&bucketOps, bucketQueue, bucket_reset, pairs,
+        numPairs, &bucketCost);
+      //the old list let a node cheaper than the top of the stack sit behind it,
+      //so the two may settle on different (equally valid) paths
+      printf("%-20s %3dx%-3d %11.2f %12.2f %7.1fx\n", argv[arg], gridWidth,
+        gridHeight, legacyMs, bucketMs, legacyMs / bucketMs);
+    }
+  }
+  disposeQueue(agent, bucketQueue);
+  agent_free(agent);
+  return 0;
+}
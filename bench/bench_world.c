@@ -0,0 +1,99 @@
+//Benchmark for the sparse map store on large worlds.
+//Generates WORLD_SIZE x WORLD_SIZE worlds (see sim_generate()), plays the agent in them in process
+//and reports the time per move along with the memory the per space arrays ended up using,
+//next to what dense arrays covering every space the agent could reach would need.
+//The worlds are played by the engine in sim.c, each by a new agent context in its own process
+//(so the peak memory reported is the world's alone).
+//
+//Build and run from the repository root:
+//  gcc -O2 -pthread -DAGENT_NO_MAIN -DSIM_NO_MAIN -o bench_world bench/bench_world.c sim.c agent.c
+//  ./bench_world [size] [moves] [worlds]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../agent.h"
+#include "../sim.h"
+
+#define WORLD_SIZE 1000
+#define MOVES 5000
+#define WORLDS 3
+
+static Game game;
+static int size;
+
+static double ms_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3 +
+    (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+//play one world and print a line of results
+static void play(unsigned int worldSeed, int maxMoves) {
+  double worst = 0;
+  struct timespec start;
+  char view[5][5];
+  AgentContext *agent = agent_new();
+
+  sim_generate(&game, size, worldSeed);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while(game.result == SIM_PLAYING && game.moves < maxMoves) {
+    struct timespec moveStart;
+    sim_view(&game, view);
+    clock_gettime(CLOCK_MONOTONIC, &moveStart);
+    char action = agent_step(agent, view);
+    double ms = ms_since(&moveStart);
+    if(ms > worst) worst = ms;
+    sim_apply(&game, action);
+  }
+  if(game.result == SIM_PLAYING) game.result = SIM_MOVES_OUT;
+  int moves = game.moves;
+  double total = ms_since(&start);
+
+  //a dense map has to cover every space the agent could reach from an unknown start
+  MapStore *world = &agent->world;
+  long dense = 4L * size * size * (world->capacity ? world->bytes / (world->capacity * TILE_CELLS) : 0);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%-6u %-9s %6d %9.3f %8.2f %7d %11.1f %11.1f %9.1f\n", worldSeed,
+    sim_result_name(game.result), moves, total / moves, worst, world->numTiles, world->bytes / 1e6,
+    dense / 1e6, usage.ru_maxrss / 1e3);
+  agent_free(agent);
+}
+
+int main(int argc, char *argv[]) {
+  size = argc > 1 ? atoi(argv[1]) : WORLD_SIZE;
+  int maxMoves = argc > 2 ? atoi(argv[2]) : MOVES;
+  int worlds = argc > 3 ? atoi(argv[3]) : WORLDS;
+  int i;
+
+  if(size < 16 || maxMoves < 1 || worlds < 1) {
+    printf("Usage: %s [size] [moves] [worlds]\n", argv[0]);
+    return 1;
+  }
+  printf("%dx%d worlds, up to %d moves each\n", size, size, maxMoves);
+  printf("%-6s %-9s %6s %9s %8s %7s %11s %11s %9s\n", "seed", "result",
+    "moves", "ms/move", "max ms", "tiles", "sparse MB", "dense MB", "rss MB");
+  fflush(stdout);
+  for(i = 0; i < worlds; i++) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if(pid == 0) {
+      play(1 + i, maxMoves);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("%-6d crashed\n", 1 + i);
+    }
+  }
+  return 0;
+}
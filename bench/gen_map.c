@@ -0,0 +1,60 @@
+//Map generator for stress testing the planner. Writes a map in the tests/*.in format to stdout, made by
+//sim_generate_map() from the seed and the options given:
+//  -n size     rows and columns (default 40; the agent has no size limit)
+//  -i islands  islands besides the agent's (default 3)
+//  -g gap      water spaces between neighbouring islands (default 1)
+//  -m maze     percent of a perfect maze's walls kept on each island (default 0, 100 is like tests/s2.in)
+//  -o stones   stones scattered over the islands
+//  -t trees    trees scattered over the islands
+//  -d doors    doors scattered over the islands
+//  -a, -k      place an axe, a key
+//  -s          make sure the map can be won (by a player who knows where to go: with a gap of 2 or more no other
+//              island is in view from the shore). On bench_batch's default mix (gap 1, up to 80x80 and 4 islands)
+//              the agent still loses about 1% of these, out of moves in mostly dense mazes (see tests/known_failures/).
+//              Large maps need far more than SIM_MAX_MOVES: 160x160 with 8 islands takes 17000 to 35000 moves
+//
+//Build and run from the repository root:
+//  gcc -O2 -pthread -DAGENT_NO_MAIN -DSIM_NO_MAIN -o gen_map bench/gen_map.c sim.c agent.c
+//  ./gen_map -n 80 -i 8 -m 60 -s 7 > big.in
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "../agent.h"
+#include "../sim.h"
+
+int main(int argc, char *argv[]) {
+  MapSpec spec = {40, 3, 1, 0, 0, 0, 0, false, false, false};
+  int option;
+
+  while((option = getopt(argc, argv, "n:i:g:m:o:t:d:aks")) != -1) {
+    switch(option) {
+      case 'n': spec.size = atoi(optarg); break;
+      case 'i': spec.islands = atoi(optarg); break;
+      case 'g': spec.gap = atoi(optarg); break;
+      case 'm': spec.maze = atoi(optarg); break;
+      case 'o': spec.stones = atoi(optarg); break;
+      case 't': spec.trees = atoi(optarg); break;
+      case 'd': spec.doors = atoi(optarg); break;
+      case 'a': spec.axe = true; break;
+      case 'k': spec.key = true; break;
+      case 's': spec.solvable = true; break;
+      default: optind = argc + 1;
+    }
+  }
+  if(optind != argc - 1 || spec.islands < 0) {
+    fprintf(stderr, "Usage: %s [-n size] [-i islands] [-g gap] [-m maze%%] [-o stones] "
+      "[-t trees] [-d doors] [-a] [-k] [-s] seed\n", argv[0]);
+    return 1;
+  }
+  Game game;
+  if(!sim_generate_map(&game, &spec, strtoul(argv[optind], NULL, 10))) {
+    fprintf(stderr, "%d islands %d apart don't fit in %dx%d\n", spec.islands + 1, spec.gap,
+      spec.size, spec.size);
+    return 1;
+  }
+  sim_write(&game, stdout);
+  putchar('\n');
+  sim_free(&game);
+  return 0;
+}
@@ -0,0 +1,565 @@
+//Headless game engine. Plays the agent in process on a map in the tests/*.in format, following the rules
+//in the README (tools, doors, trees chopped into rafts, stones put down as O, drowning, falling off the edge
+//of the world and bringing the gold home), so games need no Step engine and no socket.
+//Each move hands agent_step() the 5x5 view rotated so the agent faces up, as the engine would, and applies
+//the action it returns. The command line plays each map with a new agent context. With -p it plays each map
+//again with sim_play_ahead() (the speculation thread planning while the engine moves, as under the real engine)
+//and fails any map where that game's moves differ from the first. The tests/*.in maps are too small for the
+//map store to grow while the speculation thread plans, so tests/speculation/ has a generated map that does,
+//best played under AddressSanitizer.
+//
+//Build and run from the repository root:
+//  gcc -O2 -pthread -DAGENT_NO_MAIN -o sim sim.c agent.c
+//  ./sim [-m moves] [-p] tests/*.in
+//  gcc -g -O1 -fsanitize=address,undefined -pthread -DAGENT_NO_MAIN -o sim_asan sim.c agent.c
+//  ./sim_asan -m 20000 -p tests/speculation/*.in
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "agent.h"
+#include "sim.h"
+
+static int rowStep[4] = {-1, 0, 1, 0};
+static int colStep[4] = {0, 1, 0, -1};
+
+//an empty rows x cols map with the agent in the middle facing up
+void sim_new(Game *game, int rows, int cols) {
+  memset(game, 0, sizeof(Game));
+  game->map = malloc(rows * cols);
+  assert(game->map != NULL);
+  memset(game->map, ' ', rows * cols);
+  game->rows = rows;
+  game->cols = cols;
+  sim_start(game, rows / 2, cols / 2, UP);
+}
+
+//read a map in the tests/*.in format: one line per row, with the agent's start shown as ^, >, v or <.
+//Short lines are padded with open space. Returns false if the file can't be read or has no agent in it
+bool sim_load(Game *game, const char *path) {
+  FILE *f = fopen(path, "r");
+  if(f == NULL) return false;
+  char *text = NULL;
+  size_t length = 0;
+  size_t capacity = 0;
+  int ch;
+  while((ch = getc(f)) != EOF) {
+    if(ch == '\r') continue;
+    if(length + 1 >= capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      text = realloc(text, capacity);
+      assert(text != NULL);
+    }
+    text[length++] = ch;
+  }
+  fclose(f);
+  if(length == 0) return false;
+  if(text[length - 1] == '\n') length--;
+  text[length] = '\0';
+
+  int rows = 1, cols = 0, width = 0;
+  size_t i;
+  for(i = 0; i < length; i++) {
+    if(text[i] == '\n') {
+      rows++;
+      width = 0;
+    } else if(++width > cols) cols = width;
+  }
+  sim_new(game, rows, cols);
+  bool placed = false;
+  int row = 0, col = 0;
+  for(i = 0; i < length; i++) {
+    const char *agentSymbols = "^>v<";
+    char *heading;
+    if(text[i] == '\n') {
+      row++;
+      col = 0;
+      continue;
+    }
+    if((heading = strchr(agentSymbols, text[i])) != NULL) {
+      sim_start(game, row, col, heading - agentSymbols);
+      placed = true;
+    } else {
+      game->map[row * cols + col] = text[i];
+    }
+    col++;
+  }
+  free(text);
+  if(!placed) sim_free(game);
+  return placed;
+}
+
+void sim_free(Game *game) {
+  free(game->map);
+  game->map = NULL;
+}
+
+//the symbol at a space, with everything off the map the edge of the world
+char sim_at(Game *game, int row, int col) {
+  if(row < 0 || col < 0 || row >= game->rows || col >= game->cols) return '.';
+  return game->map[row * game->cols + col];
+}
+
+void sim_put(Game *game, int row, int col, char symbol) {
+  if(row < 0 || col < 0 || row >= game->rows || col >= game->cols) return;
+  game->map[row * game->cols + col] = symbol;
+}
+
+//put the agent at its start, empty handed
+void sim_start(Game *game, int row, int col, int heading) {
+  game->row = game->startRow = row;
+  game->col = game->startCol = col;
+  game->heading = heading;
+  game->stones = 0;
+  game->axe = game->key = game->raft = game->onRaft = game->gold = false;
+  game->moves = 0;
+  game->result = SIM_PLAYING;
+}
+
+//Generated worlds. A seeded xorshift picks everything, so a seed always makes the same world
+
+static unsigned int next_random(unsigned int *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+//put a symbol anywhere but the edge of the world
+static void put_inside(Game *game, int r, int c, char symbol) {
+  if(r > 0 && c > 0 && r < game->rows - 1 && c < game->cols - 1) sim_put(game, r, c, symbol);
+}
+
+//drop an item on a random open space at least minDist (manhattan) from the start
+static void scatter(Game *game, unsigned int *seed, char item, int count, int minDist) {
+  while(count > 0) {
+    int r = 1 + next_random(seed) % (game->rows - 2);
+    int c = 1 + next_random(seed) % (game->cols - 2);
+    if(sim_at(game, r, c) != ' ' ||
+      abs(r - game->startRow) + abs(c - game->startCol) < minDist) continue;
+    put_inside(game, r, c, item);
+    count--;
+  }
+}
+
+//a size x size world of open land with blobs of water, short wall segments, trees and doors, with the tools and
+//gold scattered far from the start (in the middle) and the edge of the world all round. It may not be winnable
+void sim_generate(Game *game, int size, unsigned int seed) {
+  int r, c, i;
+  sim_new(game, size, size);
+  for(r = 0; r < size; r++) {
+    for(c = 0; c < size; c++) {
+      if(r == 0 || c == 0 || r == size - 1 || c == size - 1) sim_put(game, r, c, '.');
+    }
+  }
+  for(i = 0; i < size * size / 400; i++) {
+    int lakeR = next_random(&seed) % size;
+    int lakeC = next_random(&seed) % size;
+    int radius = 1 + next_random(&seed) % 4;
+    for(r = lakeR - radius; r <= lakeR + radius; r++) {
+      for(c = lakeC - radius; c <= lakeC + radius; c++) {
+        if(abs(r - lakeR) + abs(c - lakeC) <= radius) put_inside(game, r, c, '~');
+      }
+    }
+  }
+  for(i = 0; i < size * size / 60; i++) {
+    r = next_random(&seed) % size;
+    c = next_random(&seed) % size;
+    int dir = next_random(&seed) % 4;
+    int length = 2 + next_random(&seed) % 6;
+    for(; length > 0; length--, r += rowStep[dir], c += colStep[dir]) {
+      put_inside(game, r, c, '*');
+    }
+  }
+  scatter(game, &seed, 'T', size * size / 300, 0);
+  scatter(game, &seed, '-', size * size / 2000, 0);
+  scatter(game, &seed, 'o', size * size / 1000, 0);
+  scatter(game, &seed, 'a', 1, size / 8);
+  scatter(game, &seed, 'k', 1, size / 8);
+  scatter(game, &seed, '$', 1, size / 4);
+  for(r = game->startRow - 2; r <= game->startRow + 2; r++) {
+    for(c = game->startCol - 2; c <= game->startCol + 2; c++) put_inside(game, r, c, ' ');
+  }
+}
+
+//Generated maps for stress testing (sim_generate_map()). The islands are odd sized squares on a grid, gap
+//water spaces apart, numbered along the rows and back again so each island is next to the one before it.
+//On an island the spaces at even places across and down are always open, and a perfect maze is dug
+//between them, so every open space can be walked to and the island's corners face its neighbours'.
+//A solvable map is built to be won: each island but the last has gap stones for the crossing to the next
+//(the straight one between corners), the gold is on the last island and the key and axe are on the agent's
+//island where it can walk to them without going through a door or tree
+
+//the square an island takes up
+typedef struct _islandBox {
+  int top;
+  int left;
+  int side;
+} IslandBox;
+
+//dig a maze over an island and keep maze percent of the walls it leaves
+static void dig_island(Game *game, unsigned int *seed, IslandBox *box, int maze) {
+  int rooms = (box->side + 1) / 2;
+  int *stack = malloc(rooms * rooms * sizeof(int));
+  bool *dug = calloc(rooms * rooms, sizeof(bool));
+  assert(stack != NULL && dug != NULL);
+  int r, c;
+  for(r = 0; r < box->side; r++) {
+    for(c = 0; c < box->side; c++) {
+      bool room = r % 2 == 0 && c % 2 == 0;
+      sim_put(game, box->top + r, box->left + c, room ? ' ' : '*');
+    }
+  }
+  int depth = 0;
+  stack[depth++] = 0;
+  dug[0] = true;
+  while(depth > 0) {
+    int room = stack[depth - 1];
+    int next[NUM_DIRECTIONS];
+    int numNext = 0;
+    int dir;
+    for(dir = 0; dir < NUM_DIRECTIONS; dir++) {
+      int nextR = room / rooms + rowStep[dir];
+      int nextC = room % rooms + colStep[dir];
+      if(nextR < 0 || nextC < 0 || nextR >= rooms || nextC >= rooms ||
+        dug[nextR * rooms + nextC]) continue;
+      next[numNext++] = dir;
+    }
+    if(numNext == 0) {
+      depth--;
+      continue;
+    }
+    dir = next[next_random(seed) % numNext];
+    r = room / rooms;
+    c = room % rooms;
+    sim_put(game, box->top + 2 * r + rowStep[dir], box->left + 2 * c + colStep[dir], ' ');
+    int nextRoom = (r + rowStep[dir]) * rooms + c + colStep[dir];
+    dug[nextRoom] = true;
+    stack[depth++] = nextRoom;
+  }
+  free(stack);
+  free(dug);
+  for(r = 0; r < box->side; r++) {
+    for(c = 0; c < box->side; c++) {
+      if(sim_at(game, box->top + r, box->left + c) == '*' &&
+        (int)(next_random(seed) % 100) >= maze) sim_put(game, box->top + r, box->left + c, ' ');
+    }
+  }
+}
+
+//put an item on a random open space of an island that isn't the agent's start. Returns false if it is full
+static bool drop_on(Game *game, unsigned int *seed, IslandBox *box, char item) {
+  int tries;
+  for(tries = 0; tries < box->side * box->side; tries++) {
+    int r = box->top + next_random(seed) % box->side;
+    int c = box->left + next_random(seed) % box->side;
+    if(sim_at(game, r, c) != ' ' || (r == game->startRow && c == game->startCol)) continue;
+    sim_put(game, r, c, item);
+    return true;
+  }
+  //the island is nearly full, so take the first free space
+  int r, c;
+  for(r = box->top; r < box->top + box->side; r++) {
+    for(c = box->left; c < box->left + box->side; c++) {
+      if(sim_at(game, r, c) != ' ' || (r == game->startRow && c == game->startCol)) continue;
+      sim_put(game, r, c, item);
+      return true;
+    }
+  }
+  return false;
+}
+
+//can the agent walk to every space of an island holding one of the items without going through a door or tree
+static bool walk_to(Game *game, IslandBox *box, const char *items) {
+  int side = box->side;
+  int *queue = malloc(side * side * sizeof(int));
+  bool *seen = calloc(side * side, sizeof(bool));
+  assert(queue != NULL && seen != NULL);
+  int head = 0, tail = 0;
+  int start = (game->startRow - box->top) * side + game->startCol - box->left;
+  queue[tail++] = start;
+  seen[start] = true;
+  while(head < tail) {
+    int space = queue[head++];
+    int dir;
+    for(dir = 0; dir < NUM_DIRECTIONS; dir++) {
+      int r = space / side + rowStep[dir];
+      int c = space % side + colStep[dir];
+      if(r < 0 || c < 0 || r >= side || c >= side || seen[r * side + c]) continue;
+      char symbol = sim_at(game, box->top + r, box->left + c);
+      if(symbol == '*' || symbol == '-' || symbol == 'T') continue;
+      seen[r * side + c] = true;
+      queue[tail++] = r * side + c;
+    }
+  }
+  bool reached = true;
+  int i;
+  for(i = 0; i < side * side; i++) {
+    char symbol = sim_at(game, box->top + i / side, box->left + i % side);
+    if(strchr(items, symbol) != NULL && !seen[i]) reached = false;
+  }
+  free(queue);
+  free(seen);
+  return reached;
+}
+
+//generate a map as the spec asks. Returns false if the islands don't fit in it
+bool sim_generate_map(Game *game, MapSpec *spec, unsigned int seed) {
+  int numIslands = spec->islands + 1;
+  int across = 1;
+  while(across * across < numIslands) across++;
+  int side = (spec->size - 2 * SIM_MARGIN - (across - 1) * spec->gap) / across;
+  if(side % 2 == 0) side--;
+  if(side < SIM_MIN_ISLAND || spec->gap < 1) return false;
+  if(seed == 0) seed = 1;
+
+  sim_new(game, spec->size, spec->size);
+  memset(game->map, '~', spec->size * spec->size);
+  IslandBox *boxes = malloc(numIslands * sizeof(IslandBox));
+  assert(boxes != NULL);
+  int i;
+  for(i = 0; i < numIslands; i++) {
+    int row = i / across;
+    int col = row % 2 == 0 ? i % across : across - 1 - i % across;
+    boxes[i].top = SIM_MARGIN + row * (side + spec->gap);
+    boxes[i].left = SIM_MARGIN + col * (side + spec->gap);
+    boxes[i].side = side;
+    dig_island(game, &seed, &boxes[i], spec->maze);
+  }
+  //the agent starts in a room of its island (which is always open)
+  int rooms = (side + 1) / 2;
+  sim_start(game, boxes[0].top + 2 * (next_random(&seed) % rooms),
+    boxes[0].left + 2 * (next_random(&seed) % rooms), next_random(&seed) % NUM_DIRECTIONS);
+
+  int last = numIslands - 1;
+  if(spec->solvable) {
+    int stone;
+    for(i = 0; i < last; i++) {
+      for(stone = 0; stone < spec->gap; stone++) drop_on(game, &seed, &boxes[i], 'o');
+    }
+    if(spec->key || spec->doors > 0) drop_on(game, &seed, &boxes[0], 'k');
+    if(spec->axe || spec->trees > 0) drop_on(game, &seed, &boxes[0], 'a');
+    drop_on(game, &seed, &boxes[last], '$');
+  } else {
+    if(spec->key) drop_on(game, &seed, &boxes[next_random(&seed) % numIslands], 'k');
+    if(spec->axe) drop_on(game, &seed, &boxes[next_random(&seed) % numIslands], 'a');
+    drop_on(game, &seed, &boxes[last > 0 ? 1 + next_random(&seed) % last : 0], '$');
+  }
+  for(i = 0; i < spec->stones; i++) drop_on(game, &seed, &boxes[next_random(&seed) % numIslands], 'o');
+  for(i = 0; i < spec->doors; i++) drop_on(game, &seed, &boxes[next_random(&seed) % numIslands], '-');
+  for(i = 0; i < spec->trees; i++) drop_on(game, &seed, &boxes[next_random(&seed) % numIslands], 'T');
+
+  //doors and trees shutting the key or axe in on the agent's island are dropped somewhere else on it
+  //until they don't, or cleared if that keeps happening
+  int tries;
+  for(tries = 0; spec->solvable && !walk_to(game, &boxes[0], "ka"); tries++) {
+    int doors = 0, trees = 0;
+    int r, c;
+    for(r = boxes[0].top; r < boxes[0].top + side; r++) {
+      for(c = boxes[0].left; c < boxes[0].left + side; c++) {
+        char symbol = sim_at(game, r, c);
+        if(symbol == '-') doors++;
+        else if(symbol == 'T') trees++;
+        else continue;
+        sim_put(game, r, c, ' ');
+      }
+    }
+    if(tries >= side) break;
+    for(; doors > 0; doors--) drop_on(game, &seed, &boxes[0], '-');
+    for(; trees > 0; trees--) drop_on(game, &seed, &boxes[0], 'T');
+  }
+  free(boxes);
+  return true;
+}
+
+//write a game's map in the tests/*.in format, with the agent where it started
+void sim_write(Game *game, FILE *out) {
+  const char *agentSymbols = "^>v<";
+  int r, c;
+  for(r = 0; r < game->rows; r++) {
+    for(c = 0; c < game->cols; c++) {
+      bool start = r == game->startRow && c == game->startCol;
+      putc(start ? agentSymbols[game->heading] : sim_at(game, r, c), out);
+    }
+    if(r < game->rows - 1) putc('\n', out);
+  }
+}
+
+//the 5x5 view around the agent rotated so the agent faces up
+void sim_view(Game *game, char view[5][5]) {
+  int i, j;
+  for(i = -POS_AGENT_IN_VIEW; i <= POS_AGENT_IN_VIEW; i++) {
+    for(j = -POS_AGENT_IN_VIEW; j <= POS_AGENT_IN_VIEW; j++) {
+      int r, c;
+      switch(game->heading) {
+        case UP: r = game->row + i; c = game->col + j; break;
+        case DOWN: r = game->row - i; c = game->col - j; break;
+        case RIGHT: r = game->row + j; c = game->col - i; break;
+        default: r = game->row - j; c = game->col + i;
+      }
+      view[POS_AGENT_IN_VIEW + i][POS_AGENT_IN_VIEW + j] = sim_at(game, r, c);
+    }
+  }
+  view[POS_AGENT_IN_VIEW][POS_AGENT_IN_VIEW] = '^';
+}
+
+//apply an action to the game and count the move. Returns how the game stands after it
+int sim_apply(Game *game, char action) {
+  if(game->result != SIM_PLAYING) return game->result;
+  game->moves++;
+  game->trace = game->trace * 31 + (unsigned char)action;
+  int r = game->row + rowStep[game->heading];
+  int c = game->col + colStep[game->heading];
+  char ahead = sim_at(game, r, c);
+  switch(action) {
+    case 'l': case 'L':
+      game->heading = (game->heading + 3) % 4;
+      return game->result;
+    case 'r': case 'R':
+      game->heading = (game->heading + 1) % 4;
+      return game->result;
+    case 'c': case 'C':
+      if(game->axe && ahead == 'T') {
+        sim_put(game, r, c, ' ');
+        game->raft = true;
+      }
+      return game->result;
+    case 'u': case 'U':
+      if(game->key && ahead == '-') sim_put(game, r, c, ' ');
+      return game->result;
+    case 'f': case 'F':
+      break;
+    default:
+      return game->result;
+  }
+  if(ahead == '*' || ahead == 'T' || ahead == '-') return game->result;
+  if(ahead == '.') return game->result = SIM_FELL;
+  if(ahead == '~') {
+    //a stone is put down before the raft is used, and the raft sinks once we step off it onto one
+    if(game->stones > 0) {
+      game->stones--;
+      sim_put(game, r, c, 'O');
+      if(game->onRaft) game->raft = false;
+      game->onRaft = false;
+    } else if(game->raft) {
+      game->onRaft = true;
+    } else {
+      return game->result = SIM_DROWNED;
+    }
+  } else if(game->onRaft) {
+    game->onRaft = false;
+    game->raft = false;
+  }
+  game->row = r;
+  game->col = c;
+  switch(ahead) {
+    case 'a': game->axe = true; sim_put(game, r, c, ' '); break;
+    case 'k': game->key = true; sim_put(game, r, c, ' '); break;
+    case 'o': game->stones++; sim_put(game, r, c, ' '); break;
+    case '$': game->gold = true; sim_put(game, r, c, ' '); break;
+  }
+  if(game->gold && r == game->startRow && c == game->startCol) game->result = SIM_WON;
+  return game->result;
+}
+
+//play an agent until the game is over or it has made maxMoves moves. Returns how the game ended
+int sim_play(Game *game, AgentContext *agent, int maxMoves) {
+  char view[5][5];
+  while(game->result == SIM_PLAYING) {
+    if(game->moves >= maxMoves) return game->result = SIM_MOVES_OUT;
+    sim_view(game, view);
+    sim_apply(game, agent_step(agent, view));
+  }
+  return game->result;
+}
+
+//sim_play() driving the agent the way main() in agent.c does: the speculation thread plans the next turn
+//while the engine applies this one, and is waited for before the agent is handed the next view
+int sim_play_ahead(Game *game, AgentContext *agent, int maxMoves) {
+  char view[5][5];
+  while(game->result == SIM_PLAYING) {
+    if(game->moves >= maxMoves) break;
+    sim_view(game, view);
+    speculation_wait(agent);
+    char action = agent_step(agent, view);
+    speculation_start(agent);
+    sim_apply(game, action);
+  }
+  speculation_wait(agent);
+  if(game->result == SIM_PLAYING) game->result = SIM_MOVES_OUT;
+  return game->result;
+}
+
+const char *sim_result_name(int result) {
+  switch(result) {
+    case SIM_PLAYING: return "playing";
+    case SIM_WON: return "won";
+    case SIM_DROWNED: return "drowned";
+    case SIM_FELL: return "fell off";
+    default: return "moves out";
+  }
+}
+
+#ifndef SIM_NO_MAIN
+static double ms_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3 +
+    (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+//play one map with a new agent and print a line of results (ahead plays it with sim_play_ahead()).
+//Returns false if the map can't be read
+static bool play(const char *path, int maxMoves, bool ahead, Game *game) {
+  struct timespec start;
+  if(!sim_load(game, path)) {
+    printf("%-20s could not read a map\n", path);
+    return false;
+  }
+  AgentContext *agent = agent_new();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int result = ahead ? sim_play_ahead(game, agent, maxMoves) : sim_play(game, agent, maxMoves);
+  double ms = ms_since(&start);
+  printf("%-20s %-9s %6d %9.3f%s\n", path, sim_result_name(result), game->moves,
+    game->moves ? ms / game->moves : 0.0, ahead ? "  (ahead)" : "");
+  agent_free(agent);
+  sim_free(game);
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  int maxMoves = SIM_MAX_MOVES;
+  int arg = 1;
+  int lost = 0;
+  bool ahead = false;
+
+  if(arg + 1 < argc && strcmp(argv[arg], "-m") == 0) {
+    maxMoves = atoi(argv[arg + 1]);
+    arg += 2;
+  }
+  if(arg < argc && strcmp(argv[arg], "-p") == 0) {
+    ahead = true;
+    arg++;
+  }
+  if(arg >= argc || maxMoves < 1) {
+    printf("Usage: %s [-m moves] [-p] map.in ...\n", argv[0]);
+    return 1;
+  }
+  printf("%-20s %-9s %6s %9s\n", "map", "result", "moves", "ms/move");
+  fflush(stdout);
+  for(; arg < argc; arg++) {
+    Game plain, planned;
+    if(!play(argv[arg], maxMoves, false, &plain) || plain.result != SIM_WON) lost++;
+    if(!ahead) continue;
+    if(!play(argv[arg], maxMoves, true, &planned)) continue;
+    if(planned.result != plain.result || planned.moves != plain.moves || planned.trace != plain.trace) {
+      printf("%-20s played differently with the speculation thread\n", argv[arg]);
+      lost++;
+    }
+  }
+  return lost > 0;
+}
+#endif
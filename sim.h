@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+//how a game stands after a move
+#define SIM_PLAYING 0
+#define SIM_WON 1
+#define SIM_DROWNED 2
+#define SIM_FELL 3
+#define SIM_MOVES_OUT 4
+//moves a game gets before it is called off, unless asked for otherwise
+#define SIM_MAX_MOVES 10000
+//water around the islands of a generated map, and the fewest spaces across an island
+#define SIM_MARGIN 2
+#define SIM_MIN_ISLAND 3
+
+//A game of the treasure hunt played in process: the map as the engine sees it (rows * cols symbols, row major,
+//with the agent's space left as whatever is under it), where the agent is and which way it faces, what it holds,
+//and how the game has gone so far (trace hashes the actions applied, so two games can be checked to have been
+//played alike)
+typedef struct _game {
+  char *map;
+  int rows;
+  int cols;
+  int row;
+  int col;
+  int heading;
+  int startRow;
+  int startCol;
+  int stones;
+  bool axe;
+  bool key;
+  bool raft;
+  bool onRaft;
+  bool gold;
+  int moves;
+  int result;
+  unsigned long trace;
+} Game;
+
+//what sim_generate_map() puts in a map: a square of size x size holding the agent's island and islands more,
+//gap water spaces apart. maze is the percent of a perfect maze's walls kept on each island (0 is open land,
+//100 a maze like tests/s2.in). stones, trees and doors are scattered over the islands and axe and key
+//place one of each. A solvable map also gets the stones, axe and key it needs to be won, on top of those
+typedef struct _mapSpec {
+  int size;
+  int islands;
+  int gap;
+  int maze;
+  int stones;
+  int trees;
+  int doors;
+  bool axe;
+  bool key;
+  bool solvable;
+} MapSpec;
+
+void sim_new(Game *game, int rows, int cols);
+bool sim_load(Game *game, const char *path);
+void sim_free(Game *game);
+char sim_at(Game *game, int row, int col);
+void sim_put(Game *game, int row, int col, char symbol);
+void sim_start(Game *game, int row, int col, int heading);
+void sim_generate(Game *game, int size, unsigned int seed);
+bool sim_generate_map(Game *game, MapSpec *spec, unsigned int seed);
+void sim_write(Game *game, FILE *out);
+void sim_view(Game *game, char view[5][5]);
+int sim_apply(Game *game, char action);
+int sim_play(Game *game, AgentContext *agent, int maxMoves);
+int sim_play_ahead(Game *game, AgentContext *agent, int maxMoves);
+const char *sim_result_name(int result);